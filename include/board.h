@@ -17,6 +17,11 @@ struct CastlingRights {
 class ChessBoard {
 public:
   std::array<std::uint64_t, Piece::KING + 1> whites, blacks;
+  // Unions of the piece bitboards above, kept up to date by makeMove/undoMove
+  std::uint64_t whiteFlat, blackFlat, occupied;
+  // Piece type on every square, for lookups the bitboards would have to scan
+  // for. The color comes from the flats
+  std::array<Piece, BOARD_AREA> mailbox;
   std::uint64_t zobrist;
   std::uint32_t halfmoveClock : 7;
   std::uint32_t enPassantSquare : 6; // 0 means "no en passant"
@@ -27,16 +32,15 @@ public:
   explicit ChessBoard(const std::string &fen);
 
   [[nodiscard]] auto getFlat(const bool forWhites) const -> std::uint64_t {
-    const std::array<std::uint64_t, Piece::KING + 1> &color =
-        forWhites ? this->whites : this->blacks;
+    return forWhites ? whiteFlat : blackFlat;
+  }
 
-    std::uint64_t result = 0;
-    for (std::uint32_t type = Piece::PAWN; type <= Piece::KING; type++) {
-      result |= color[type];
-    }
+  // Rebuilds the flats and the mailbox after the piece bitboards were edited
+  // directly
+  void updateOccupancy();
 
-    return result;
-  }
+  // Whether the flats and the mailbox match the piece bitboards, for asserts
+  [[nodiscard]] auto isOccupancyInSync() const -> bool;
 
   [[nodiscard]] auto getCompressedCastlingRights() const -> std::uint8_t {
     // Masked to ensure only the first 4 bits can be set
@@ -57,9 +61,9 @@ public:
 
   [[nodiscard]] auto evaluate() const -> std::int32_t;
 
-  [[nodiscard]] auto
-  isDraw(const std::array<std::uint64_t, ZOBRIST_HISTORY_SIZE> &zobristHistory)
-      const -> bool;
+  // Fifty-move rule and insufficient material, repetitions need the game and
+  // are left to the search
+  [[nodiscard]] auto isDraw() const -> bool;
 
   [[nodiscard]] auto calculateZobrist() const -> std::uint64_t;
 
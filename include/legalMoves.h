@@ -2,9 +2,14 @@
 
 #include "board.h"
 #include "sysifus.h"
+#include <array>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
 #include <string>
-#include <vector>
 
 static constexpr std::uint8_t MAX_DEPTH = 120;
 
@@ -26,6 +31,12 @@ struct MoveCTX {
 
   [[nodiscard]] auto see(std::uint64_t whitesFlat, const ChessBoard &board,
                          std::uint64_t blacksFlat) const -> std::int32_t;
+
+  // 16 bit encoding, enough to tell the move apart from any other in the same
+  // position. Never 0, because promotion is NOTHING on non-promotions
+  [[nodiscard]] auto pack() const -> std::uint16_t {
+    return static_cast<std::uint16_t>(from | (to << 6) | (promotion << 12));
+  }
 };
 
 auto fromAlgebraic(const std::string_view &algebraic, const ChessBoard &board)
@@ -35,86 +46,189 @@ auto moveToUCI(const MoveCTX &move) -> std::string;
 
 constexpr std::uint32_t MAX_MOVES_IN_A_POSITION = 218;
 
-static constexpr std::uint8_t BUCKETS_LEN = 8;
-enum BucketEnum : std::uint8_t {
-  TT = 0,
-  CHECKS,
-  GOOD_CAPTURES,
-  KILLERS,
-  PROMOTIONS,
-  HISTORY_HEURISTICS,
-  BAD_CAPTURES,
-  QUIET,
+// Fixed-capacity list stored inline in its owner, so generating the moves of
+// a node never touches the heap. The storage is raw bytes, constructing a
+// list doesn't initialize MAX_MOVES_IN_A_POSITION moves it may never use
+class MoveList {
+public:
+  void push_back(const MoveCTX &move) {
+    assert(count < MAX_MOVES_IN_A_POSITION);
+    std::construct_at(data() + count, move);
+    count++;
+  }
+
+  void clear() { count = 0; }
+
+  // Moves past the old size are left unset, the caller writes all of them
+  void resize(const std::size_t size) {
+    assert(size <= MAX_MOVES_IN_A_POSITION);
+    count = static_cast<std::uint32_t>(size);
+  }
+
+  [[nodiscard]] auto empty() const -> bool { return count == 0; }
+  [[nodiscard]] auto size() const -> std::size_t { return count; }
+
+  [[nodiscard]] auto data() -> MoveCTX * {
+    return std::launder(reinterpret_cast<MoveCTX *>(storage.data()));
+  }
+  [[nodiscard]] auto data() const -> const MoveCTX * {
+    return std::launder(reinterpret_cast<const MoveCTX *>(storage.data()));
+  }
+
+  [[nodiscard]] auto begin() -> MoveCTX * { return data(); }
+  [[nodiscard]] auto end() -> MoveCTX * { return data() + count; }
+  [[nodiscard]] auto begin() const -> const MoveCTX * { return data(); }
+  [[nodiscard]] auto end() const -> const MoveCTX * { return data() + count; }
+
+  [[nodiscard]] auto operator[](const std::size_t index) -> MoveCTX & {
+    return data()[index];
+  }
+  [[nodiscard]] auto operator[](const std::size_t index) const
+      -> const MoveCTX & {
+    return data()[index];
+  }
+
+private:
+  alignas(MoveCTX)
+      std::array<std::byte, sizeof(MoveCTX) * MAX_MOVES_IN_A_POSITION> storage;
+  std::uint32_t count = 0;
 };
 
-inline auto operator++(BucketEnum &bucket) -> BucketEnum & {
-  bucket = static_cast<BucketEnum>(static_cast<std::uint8_t>(bucket) + 1);
-  return bucket;
-}
+// Which moves `MoveGenerator::generate` produces
+enum class GenerationType : std::uint8_t {
+  ALL,
+  KILLS,
+  QUIETS, // Everything but captures, castling excluded
+};
 
 // For only one color
 class MoveGenerator {
 public:
-  std::vector<MoveCTX> pseudoLegal;
-  std::array<std::vector<MoveCTX>, BUCKETS_LEN> buckets;
-
-  const std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> *killers = nullptr;
-  const std::array<
-      std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
-      *history = nullptr;
+  MoveList moves;
 
   const ChessBoard &board;
 
-  MoveGenerator(
-      const std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> &_killers,
-      const std::array<
-          std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
-          &_history,
-      const ChessBoard &_board)
-      : killers(&_killers), history(&_history), board(_board) {
-    pseudoLegal.reserve(MAX_MOVES_IN_A_POSITION);
-
-    buckets[BucketEnum::TT].reserve(TT_RESERVE);
-    buckets[BucketEnum::CHECKS].reserve(CHECKS_RESERVE);
-    buckets[BucketEnum::GOOD_CAPTURES].reserve(GOOD_CAPTURES_RESERVE);
-    buckets[BucketEnum::KILLERS].reserve(KILLERS_RESERVE);
-    buckets[BucketEnum::PROMOTIONS].reserve(PROMOTIONS_RESERVE);
-    buckets[BucketEnum::HISTORY_HEURISTICS].reserve(HISTORY_HEURISTICS_RESERVE);
-    buckets[BucketEnum::BAD_CAPTURES].reserve(BAD_CAPTURES_RESERVE);
-    buckets[BucketEnum::QUIET].reserve(QUIET_RESERVE);
-  }
+  explicit MoveGenerator(const ChessBoard &_board) : board(_board) {}
+
+  void generate(GenerationType generationType, bool forWhites);
 
-  explicit MoveGenerator(const ChessBoard &_board) : board(_board) {
-    pseudoLegal.reserve(MAX_MOVES_IN_A_POSITION);
-
-    buckets[BucketEnum::TT].reserve(TT_RESERVE);
-    buckets[BucketEnum::CHECKS].reserve(CHECKS_RESERVE);
-    buckets[BucketEnum::GOOD_CAPTURES].reserve(GOOD_CAPTURES_RESERVE);
-    buckets[BucketEnum::KILLERS].reserve(KILLERS_RESERVE);
-    buckets[BucketEnum::PROMOTIONS].reserve(PROMOTIONS_RESERVE);
-    buckets[BucketEnum::HISTORY_HEURISTICS].reserve(HISTORY_HEURISTICS_RESERVE);
-    buckets[BucketEnum::BAD_CAPTURES].reserve(BAD_CAPTURES_RESERVE);
-    buckets[BucketEnum::QUIET].reserve(QUIET_RESERVE);
+  void generatePseudoLegal(const bool onlyKills, const bool forWhites) {
+    generate(onlyKills ? GenerationType::KILLS : GenerationType::ALL,
+             forWhites);
   }
 
-  void generatePseudoLegal(bool onlyKills, bool forWhites);
+  // Only legal moves, castling included unless `generationType` is KILLS. No
+  // move has to be made and checked for leaving the king attacked
+  void generateLegal(GenerationType generationType, bool forWhites);
 
   void appendCastling(const ChessBoard &board, bool forWhites);
 
-  void sort(const MoveCTX *entryBestMove, std::uint8_t ply, bool forWhites);
+  // Turns a MoveCTX::pack() code back into the full move, as long as it's
+  // pseudo-legal in this position (castling excluded). Lets a TT or killer
+  // move be searched before anything is generated
+  [[nodiscard]] auto unpack(std::uint16_t packed, bool forWhites,
+                            MoveCTX &outMove) -> bool;
 
-private:
-  static constexpr std::uint8_t TT_RESERVE = 1;
-  static constexpr std::uint8_t CHECKS_RESERVE = 16;
-  static constexpr std::uint8_t GOOD_CAPTURES_RESERVE = 8;
-  static constexpr std::uint8_t KILLERS_RESERVE = 2;
-  static constexpr std::uint8_t PROMOTIONS_RESERVE = 24;
-  static constexpr std::uint8_t HISTORY_HEURISTICS_RESERVE = 32;
-  static constexpr std::uint8_t BAD_CAPTURES_RESERVE = 8;
-  static constexpr std::uint8_t QUIET_RESERVE = 48;
+  // Finds the checkers and pinned pieces of the side to move. Done once per
+  // node, `generateLegal` and `isLegal` run on top of it
+  void analyzeKing(bool forWhites);
+
+  // Whether a pseudo-legal move leaves the king safe, needs `analyzeKing`
+  [[nodiscard]] auto isLegal(const MoveCTX &move) const -> bool;
 
+  [[nodiscard]] auto inCheck() const -> bool { return checkers != 0; }
+
+private:
   std::uint64_t friendlyFlat = 0;
   std::uint64_t enemyFlat = 0;
 
+  // Filled by analyzeKing
+  bool analyzedForWhites = false;
+  bool analyzed = false;
+  std::uint8_t kingSquare = 0;
+  std::uint64_t checkers = 0;
+  // Squares a non-king move has to land on, the checker and the squares
+  // between it and the king in single check, everything out of check
+  std::uint64_t checkMask = 0;
+  std::uint64_t pinned = 0;
+  // Squares pinned piece `i` may move to, the ray up to and including its
+  // pinner. Only set for the squares in `pinned`
+  std::array<std::uint64_t, BOARD_AREA> pinRays;
+
+  void fillCapture(MoveCTX &ctx, bool forWhites) const;
   void appendContext(MoveCTX &ctx, bool forWhites);
+
+  [[nodiscard]] auto isAttacked(std::uint32_t square,
+                                std::uint64_t occupancy) const -> bool;
+  [[nodiscard]] auto isEnPassantLegal(std::uint32_t from) const -> bool;
+  void appendLegalKingMoves(GenerationType generationType);
+  void appendLegalMoves(GenerationType generationType,
+                        std::uint64_t targetMask);
+  void generateEvasions(GenerationType generationType);
+};
+
+// Stages of MovePicker, in the order they are tried
+enum class MoveStage : std::uint8_t {
+  TT,
+  GENERATE_CAPTURES,
+  GOOD_CAPTURES, // SEE >= 0, MVV-LVA ordered
+  KILLERS,
+  GENERATE_QUIETS,
+  QUIETS, // Promotions, then history, then PSQT ordered
+  BAD_CAPTURES,
+  DONE,
+};
+
+// Hands out the moves of a node one at a time and only generates (and SEEs)
+// the next group of moves once the previous one ran out, so a node that cuts
+// off on the TT move or a capture never generates its quiets
+class MovePicker {
+public:
+  // `entryBestMove` is the packed TT move, 0 if there is none. With
+  // `onlyCaptures` just the TT move (if it's a capture) and the good captures
+  // are handed out
+  MovePicker(
+      const ChessBoard &_board, std::uint16_t _entryBestMove,
+      const std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> &_killers,
+      const std::array<
+          std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
+          &_history,
+      const std::uint8_t _ply, const bool _onlyCaptures)
+      : generator(_board), killers(_killers), history(_history),
+        entryBestMove(_entryBestMove), ply(_ply),
+        forWhites(_board.whiteToMove), onlyCaptures(_onlyCaptures) {}
+
+  // False once every stage ran out
+  [[nodiscard]] auto next(MoveCTX &outMove) -> bool;
+
+  // Stage of the last move `next` handed out
+  [[nodiscard]] auto stage() const -> MoveStage { return pickedStage; }
+
+private:
+  MoveGenerator generator;
+  MoveList badCaptures;
+
+  const std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> &killers;
+  const std::array<
+      std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
+      &history;
+
+  std::uint16_t entryBestMove;
+  std::uint8_t ply;
+  bool forWhites;
+  bool onlyCaptures;
+
+  MoveStage currentStage = MoveStage::TT;
+  MoveStage pickedStage = MoveStage::TT;
+  std::size_t index = 0; // Next move of the current stage
+  // Packed moves already handed out by the TT and killer stages, 0 if none
+  std::array<std::uint16_t, 3> handedOut{};
+
+  [[nodiscard]] auto wasHandedOut(const MoveCTX &move) const -> bool {
+    const std::uint16_t packed = move.pack();
+    return packed == handedOut[0] || packed == handedOut[1] ||
+           packed == handedOut[2];
+  }
+
+  [[nodiscard]] auto quietScore(const MoveCTX &move) const -> std::int32_t;
 };
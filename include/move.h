@@ -2,20 +2,30 @@
 
 #include "board.h"
 #include "legalMoves.h"
+#include <cstdint>
+#include <type_traits>
 
+// What undoMove can't work out from the move itself. It owns a copy of the
+// move and is trivially copyable, so records can be kept in plain preallocated
+// stacks and outlive the move list they came from
 struct UndoCTX {
-  const MoveCTX &move;
-  CastlingRights castlingRights;
-  std::uint32_t halfmoveClock : 7;
-  std::uint32_t enPassantSquare : 6; // 0 means no en passant
-  std::uint64_t zobrist;
+  std::uint64_t zobrist = 0;
+  MoveCTX move;
+  std::uint32_t castlingRights : 4 = 0; // As getCompressedCastlingRights()
+  std::uint32_t halfmoveClock : 7 = 0;
+  std::uint32_t enPassantSquare : 6 = 0; // 0 means no en passant
 
+  UndoCTX() = default;
   UndoCTX(const MoveCTX &_move, const ChessBoard &board)
-      : move(_move), castlingRights(board.castlingRights),
+      : zobrist(board.zobrist), move(_move),
+        castlingRights(board.getCompressedCastlingRights()),
         halfmoveClock(board.halfmoveClock),
-        enPassantSquare(board.enPassantSquare), zobrist(board.zobrist) {}
+        enPassantSquare(board.enPassantSquare) {}
 };
 
+static_assert(std::is_trivially_copyable_v<UndoCTX>);
+static_assert(sizeof(UndoCTX) == 16);
+
 void movePieceToDestination(ChessBoard &board, const MoveCTX &ctx);
 void makeMove(ChessBoard &board, const MoveCTX &ctx);
 void undoMove(ChessBoard &board, const UndoCTX &ctx);
@@ -1,7 +1,51 @@
 #pragma once
 
 #include "board.h"
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
-auto perft(std::uint8_t depth, ChessBoard &board, bool printMoves)
-    -> std::uint64_t;
\ No newline at end of file
+// Subtree sizes keyed by zobrist and depth. Transpositions are common enough
+// in perft trees that deep runs skip most of the work. Threads share it
+// without a lock: the key is stored XORed with the data, so a torn slot just
+// misses
+class PerftTable {
+public:
+  static constexpr std::size_t MAX_SIZE_MB = 65536;
+
+  explicit PerftTable(std::size_t megabytes);
+
+  [[nodiscard]] auto probe(std::uint64_t zobrist, std::uint8_t depth,
+                           std::uint64_t &outNodes) -> bool;
+  void store(std::uint64_t zobrist, std::uint8_t depth, std::uint64_t nodes);
+
+private:
+  // Depth lives in the low byte of `data`, a zero `data` is an empty slot
+  struct Entry {
+    std::uint64_t key;
+    std::uint64_t data;
+  };
+
+  std::vector<Entry> entries;
+  std::uint64_t indexMask = 0;
+
+  [[nodiscard]] auto index(std::uint64_t zobrist, std::uint8_t depth) const
+      -> std::size_t;
+};
+
+// Leaves are counted from the legal move list instead of being made. `table`
+// is optional
+auto perft(std::uint8_t depth, ChessBoard &board, bool printMoves,
+           PerftTable *table = nullptr) -> std::uint64_t;
+
+// Same count and divide output as perft(), with the tree split at ply 2 over
+// `threads` workers that each make moves on their own copy of `board`
+auto parallelPerft(std::uint8_t depth, const ChessBoard &board, bool printMoves,
+                   std::uint32_t threads, PerftTable *table = nullptr)
+    -> std::uint64_t;
+
+// Runs the standard perft positions up to `maxDepth` (0 means each position's
+// deepest reference count) and prints nodes, correctness and speed. Returns
+// whether every count matched
+auto perftSuite(std::uint8_t maxDepth, std::uint32_t threads = 1,
+                PerftTable *table = nullptr) -> bool;
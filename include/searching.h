@@ -4,78 +4,279 @@
 #include "board.h"
 #include "legalMoves.h"
 #include "move.h"
+#include "timeManager.h"
 #include "zobrist.h"
+#include <algorithm>
+#include <atomic>
 #include <bit>
+#include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
+#include <span>
+#include <string>
 #include <vector>
 
-static constexpr std::int32_t CHECKMATE_SCORE = 50000;
+// Scores have to fit the 16 bits of a TT entry, mates included
+static constexpr std::int32_t CHECKMATE_SCORE = 30000;
 static constexpr std::int32_t CHECKMATE_THRESHOLD = CHECKMATE_SCORE - 1000;
 static constexpr std::int32_t INF = CHECKMATE_SCORE + 1000;
 static constexpr std::uint8_t MAX_SEARCHING_DEPTH = 63;
+static constexpr std::uint32_t MAX_THREADS = 256;
 
 struct TTEntry {
-  std::uint64_t key = UINT64_MAX; // Zobrist
-  std::int32_t score = 0;
-  std::uint8_t depth = 0;
   enum BoundFlag : std::uint8_t {
     EXACT = 0,      // Exact score
     LOWERBOUND = 1, // score >= true value (alpha cut-off)
     UPPERBOUND = 2  // score <= true value (beta cut-off)
-  } flag = EXACT;
-  MoveCTX bestMove{};
+  };
+
+  std::uint16_t bestMove = 0; // MoveCTX::pack(), 0 means an empty slot
+  std::int16_t score = 0;
+  std::int16_t staticEval = 0; // Side to move relative
+  std::uint8_t depth = 0;
+  BoundFlag flag = EXACT;
+  std::uint8_t age = 0; // Search generation that wrote the entry
+
+  [[nodiscard]] auto isEmpty() const -> bool { return bestMove == 0; }
+
+  // Everything but the key in one word, so it's read and written atomically
+  [[nodiscard]] auto pack() const -> std::uint64_t {
+    return static_cast<std::uint64_t>(bestMove) |
+           (static_cast<std::uint64_t>(static_cast<std::uint16_t>(score))
+            << 16) |
+           (static_cast<std::uint64_t>(static_cast<std::uint16_t>(staticEval))
+            << 32) |
+           (static_cast<std::uint64_t>(depth) << 48) |
+           (static_cast<std::uint64_t>(flag) << 56) |
+           (static_cast<std::uint64_t>(age) << 58);
+  }
+
+  [[nodiscard]] static auto unpack(const std::uint64_t data) -> TTEntry {
+    static constexpr std::uint64_t FLAG_MASK = 0x3;
+    static constexpr std::uint64_t AGE_MASK = 0x3F;
+
+    return {
+        .bestMove = static_cast<std::uint16_t>(data),
+        .score = static_cast<std::int16_t>(data >> 16),
+        .staticEval = static_cast<std::int16_t>(data >> 32),
+        .depth = static_cast<std::uint8_t>(data >> 48),
+        .flag = static_cast<BoundFlag>((data >> 56) & FLAG_MASK),
+        .age = static_cast<std::uint8_t>((data >> 58) & AGE_MASK),
+    };
+  }
+};
+
+static constexpr std::size_t TT_CLUSTER_SIZE = 6;
+
+// One cache line, so probing a whole cluster costs a single miss. Slot `i` is
+// `data[i]`, a packed TTEntry, and `keys[i]`, the upper 16 zobrist bits (the
+// lower ones picked the cluster) XORed with a fold of `data[i]`. Both are
+// accessed with relaxed atomics and no lock: if two threads race on a slot, a
+// reader can pair one writer's key with another's data, the XOR doesn't check
+// out and the slot simply reads as a miss
+struct alignas(64) TTCluster {
+  std::array<std::uint64_t, TT_CLUSTER_SIZE> data{};
+  std::array<std::uint16_t, TT_CLUSTER_SIZE> keys{};
+};
+
+static_assert(sizeof(TTCluster) == 64);
+
+// What the table memory ended up being backed by, best first
+enum class TTBacking : std::uint8_t {
+  HUGETLB,          // Explicit huge pages, mmap with MAP_HUGETLB
+  TRANSPARENT_HUGE, // 2 MB aligned and madvise(MADV_HUGEPAGE)'d
+  REGULAR,          // Plain 4 KB pages
+  FILE,             // Private mapping of a hash file from `load`
 };
 
 class TranspositionTable {
 public:
-  TranspositionTable() { table.resize(TT_SIZE); }
-  std::vector<TTEntry> table;
+  static constexpr std::size_t DEFAULT_SIZE_MB = 32;
+  static constexpr std::size_t MIN_SIZE_MB = 1;
+  static constexpr std::size_t MAX_SIZE_MB = 65536;
+
+  TranspositionTable() { resize(DEFAULT_SIZE_MB); }
+  TranspositionTable(TranspositionTable &&) = delete;
+  TranspositionTable(const TranspositionTable &) = delete;
+  auto operator=(TranspositionTable &&) -> TranspositionTable & = delete;
+  auto operator=(const TranspositionTable &) -> TranspositionTable & = delete;
+  ~TranspositionTable() { release(); }
+
+  // Copies the entry out, since the slot may be rewritten at any time
+  [[nodiscard]] auto probe(const std::uint64_t key, TTEntry &outEntry) const
+      -> bool {
+    const std::uint16_t verification = verificationKey(key);
+    TTCluster &cluster = table[key & indexMask];
+
+    for (std::size_t i = 0; i < TT_CLUSTER_SIZE; i++) {
+      const std::uint64_t data = relaxedLoad(cluster.data[i]);
+      if (data != 0 &&
+          (relaxedLoad(cluster.keys[i]) ^ foldData(data)) == verification) {
+        outEntry = TTEntry::unpack(data);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  void store(const std::uint64_t key, TTEntry newEntry) {
+    const std::uint16_t verification = verificationKey(key);
+    newEntry.age = generation;
+
+    TTCluster &cluster = table[key & indexMask];
+    std::size_t replaced = 0;
+    std::int32_t replacedWorth = INT32_MAX;
+
+    for (std::size_t i = 0; i < TT_CLUSTER_SIZE; i++) {
+      const std::uint64_t data = relaxedLoad(cluster.data[i]);
+      if (data == 0) {
+        write(cluster, i, verification, newEntry);
+        return;
+      }
 
-  [[nodiscard]] auto probe(const std::uint64_t key) const -> const TTEntry * {
-    const TTEntry *entry = &table[key & INDEX_MASK];
+      const TTEntry entry = TTEntry::unpack(data);
 
-    if (entry->key == key) {
-      return entry;
+      if ((relaxedLoad(cluster.keys[i]) ^ foldData(data)) == verification) {
+        // Same position from the current search is only pushed out by results
+        // that are about as deep, so the next move still finds the expensive
+        // subtrees
+        if (entry.age == generation &&
+            newEntry.depth + REPLACE_DEPTH_MARGIN < entry.depth) {
+          return;
+        }
+
+        write(cluster, i, verification, newEntry);
+        return;
+      }
+
+      const std::int32_t worth = replacementWorth(entry);
+      if (worth < replacedWorth) {
+        replaced = i;
+        replacedWorth = worth;
+      }
     }
 
-    return nullptr;
+    // Cluster is full of other positions, evict the shallowest and oldest
+    write(cluster, replaced, verification, newEntry);
   }
 
-  void store(const TTEntry &newEntry) {
-    TTEntry *entry = &table[newEntry.key & INDEX_MASK];
+  // Starts pulling the cluster of `key` into cache, so the miss overlaps with
+  // whatever runs between makeMove and the probe of the child node
+  void prefetch(const std::uint64_t key) const {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(&table[key & indexMask]);
+#else
+    static_cast<void>(key);
+#endif
+  }
 
-    // If slot is empty
-    if (entry->key == UINT64_MAX) {
-      *entry = newEntry;
-      return;
+  // Called once per `go`, ages every entry without touching the table
+  void newSearch() { generation = (generation + 1) & AGE_MASK; }
+
+  // Permill of the sampled entries written by the current search
+  [[nodiscard]] auto hashfull() const -> std::uint32_t {
+    static constexpr std::size_t SAMPLED_CLUSTERS = 1000;
+    static constexpr std::uint32_t HASHFULL_SCALE = 1000;
+
+    const std::size_t clusters = std::min(SAMPLED_CLUSTERS, clusterCount);
+    std::uint32_t count = 0;
+    for (std::size_t i = 0; i < clusters; i++) {
+      for (std::uint64_t &data : table[i].data) {
+        const TTEntry entry = TTEntry::unpack(relaxedLoad(data));
+        if (!entry.isEmpty() && entry.age == generation) {
+          count++;
+        }
+      }
     }
 
-    // Replace if deeper or always if it's a different position
-    if (newEntry.depth >= entry->depth || entry->key != newEntry.key) {
-      *entry = newEntry;
-    }
+    return count * HASHFULL_SCALE / (clusters * TT_CLUSTER_SIZE);
   }
 
-  void clear() {
-    table.clear();
-    table.resize(TT_SIZE);
-  }
+  // Cluster count is rounded down to a power of 2 so indexing is a mask.
+  // Fresh mappings come zeroed from the kernel and are left untouched, so each
+  // page is first touched (and placed on a NUMA node) by a search thread.
+  // Throws `std::bad_alloc` and keeps the current table if the new one can't
+  // be allocated
+  void resize(std::size_t megabytes, std::uint32_t threads = 1);
+
+  // Gives the pages of an anonymous mapping back to the kernel. A hash file
+  // or `operator new` table is zeroed in slices across `threads` workers
+  void clear(std::uint32_t threads = 1);
+
+  // Writes a header and the raw clusters, so `load` can map them back as is.
+  // Goes through a temporary file, since the current table may be a mapping of
+  // `path` itself
+  [[nodiscard]] auto save(const std::string &path) const -> bool;
+
+  // Maps a file from `save` copy-on-write in place of the table, pages are
+  // read lazily on first probe. Keeps the current table if the file doesn't
+  // check out
+  [[nodiscard]] auto load(const std::string &path) -> bool;
+
+  [[nodiscard]] auto size() const -> std::size_t { return clusterCount; }
 
-  static auto size() -> std::size_t { return TT_SIZE; }
+  [[nodiscard]] auto backing() const -> TTBacking { return memoryBacking; }
+  [[nodiscard]] auto backingName() const -> const char *;
 
 private:
-  static constexpr std::size_t TT_SIZE_MB = 32;
   static constexpr std::size_t MB_TO_BYTE_SCALE_FACTOR = 1048576;
 
-  static constexpr std::size_t TT_SIZE_BYTES =
-      TT_SIZE_MB * MB_TO_BYTE_SCALE_FACTOR;
-  // Round down to power of 2
-  static constexpr std::size_t TT_SIZE =
-      std::bit_floor(TT_SIZE_BYTES / sizeof(TTEntry));
+  static constexpr std::uint8_t REPLACE_DEPTH_MARGIN = 2;
+  static constexpr std::uint8_t AGE_MASK = 0x3F;
+  // How many plies of depth one search of age is worth when evicting
+  static constexpr std::int32_t AGE_DEPTH_WEIGHT = 8;
+  static constexpr std::uint32_t VERIFICATION_SHIFT = 48;
+
+  TTCluster *table = nullptr;
+  std::size_t clusterCount = 0;
+  std::size_t allocatedBytes = 0;
+  TTBacking memoryBacking = TTBacking::REGULAR;
+  void *mapping = nullptr; // Start of the mmap'd range, may precede `table`
+
+  std::uint64_t indexMask = 0;
+  std::uint8_t generation = 0;
+
+  // Points the members at a new block, or throws and leaves them alone
+  void allocate(std::size_t bytes);
+  void release();
+
+  [[nodiscard]] static auto verificationKey(const std::uint64_t key)
+      -> std::uint16_t {
+    return static_cast<std::uint16_t>(key >> VERIFICATION_SHIFT);
+  }
 
-  static const std::uint64_t INDEX_MASK = TT_SIZE - 1;
+  [[nodiscard]] static auto foldData(const std::uint64_t data)
+      -> std::uint16_t {
+    return static_cast<std::uint16_t>(data ^ (data >> 16) ^ (data >> 32) ^
+                                      (data >> 48));
+  }
+
+  template <typename T> [[nodiscard]] static auto relaxedLoad(T &value) -> T {
+    return std::atomic_ref<T>(value).load(std::memory_order_relaxed);
+  }
+
+  template <typename T> static void relaxedStore(T &value, const T desired) {
+    std::atomic_ref<T>(value).store(desired, std::memory_order_relaxed);
+  }
+
+  // Data goes first, a reader catching the slot halfway sees the new data
+  // with the old key and rejects it
+  static void write(TTCluster &cluster, const std::size_t slot,
+                    const std::uint16_t verification, const TTEntry &entry) {
+    const std::uint64_t data = entry.pack();
+    relaxedStore(cluster.data[slot], data);
+    relaxedStore(cluster.keys[slot],
+                 static_cast<std::uint16_t>(verification ^ foldData(data)));
+  }
+
+  [[nodiscard]] auto replacementWorth(const TTEntry &entry) const
+      -> std::int32_t {
+    const std::int32_t relativeAge = (generation - entry.age) & AGE_MASK;
+    return entry.depth - (relativeAge * AGE_DEPTH_WEIGHT);
+  }
 };
 
 constexpr std::array<std::int32_t, Piece::NOTHING + 1> PIECE_VALUES = {
@@ -88,8 +289,13 @@ enum class NodeType : std::uint8_t {
 
 class Searching {
 public:
-  explicit Searching(ChessBoard &_board) : board(_board) {
-    zobristHistory.fill(~0ULL);
+  Searching(ChessBoard &_board, TranspositionTable &_TT)
+      : Searching(_board, _TT, stopFlag) {}
+
+  // Helpers share the table and the stop flag of the thread that owns them
+  Searching(ChessBoard &_board, TranspositionTable &_TT,
+            std::atomic<bool> &_stop)
+      : board(_board), TT(_TT), stop(_stop) {
     for (auto &color : history) {
       for (auto &row : color) {
         row.fill(0); // Initialize history to 0
@@ -98,82 +304,179 @@ public:
     for (auto &killer : killers) {
       killer.fill(MoveCTX{}); // Initialize killers to empty moves
     }
-  }; // ~0ULL means no key
-  Searching(Searching &&) = default;
-  Searching(const Searching &) = default;
+  };
+  Searching(Searching &&) = delete;
+  Searching(const Searching &) = delete;
   auto operator=(Searching &&) -> Searching & = delete;
   auto operator=(const Searching &) -> Searching & = delete;
   ~Searching() = default;
 
   ChessBoard &board;
-  std::uint64_t nodes = 0;
+  std::atomic<std::uint64_t> nodes = 0;
   std::uint64_t seldepth = 0;
 
   [[nodiscard]] auto search(std::uint8_t depth)
       -> std::pair<MoveCTX, std::int32_t>;
 
-  auto iterativeDeepening(std::uint64_t timeLimitMs) -> MoveCTX;
+  // Call prepareSearch() first. While pondering the clock is ignored, and the
+  // best move isn't returned before ponderhit() or requestStop()
+  auto iterativeDeepening(const TimeManager &time,
+                          std::uint8_t maxDepth = MAX_SEARCHING_DEPTH - 1)
+      -> MoveCTX;
+
+  // Clears the stop flag before the search thread is started, a `stop` that
+  // comes right after `go` would otherwise be lost
+  void prepareSearch(const bool ponder) {
+    stop.store(false, std::memory_order_relaxed);
+    pondering.store(ponder, std::memory_order_relaxed);
+  }
 
-  void afterSearch() {
-    auto reduceOldBonusColor = [&](const std::uint8_t forWhites) {
-      for (std::uint32_t fromSquare = 0; fromSquare < BOARD_AREA;
-           fromSquare++) {
-        for (std::uint32_t toSquare = 0; toSquare < BOARD_AREA; toSquare++) {
-          history[forWhites][fromSquare][toSquare] >>= 1;
-        }
-      }
-    };
+  // Both are called from the input thread while the search runs
+  void requestStop() {
+    stop.store(true, std::memory_order_relaxed);
+    endPondering();
+  }
 
-    reduceOldBonusColor(1);
-    reduceOldBonusColor(0);
+  // The opponent played the move we pondered on, the clock starts now
+  void ponderhit();
 
-    for (auto &depth : killers) {
-      depth.fill(MoveCTX());
-    }
+  [[nodiscard]] auto isPondering() const -> bool {
+    return pondering.load(std::memory_order_relaxed);
+  }
 
-    TT.clear();
+  // Best root moves with their score and line, best first
+  struct RootLine {
+    std::int32_t score = 0;
+    std::uint8_t length = 0;
+    std::array<MoveCTX, MAX_DEPTH + 1> moves{};
+  };
 
-    nodes = 0;
-    seldepth = 0;
+  // Number of best root moves each iteration searches, one line per pass
+  void setMultiPV(std::uint32_t lines);
+
+  // Lines of the last iteration that finished, fewer than MultiPV when the
+  // root has fewer legal moves
+  [[nodiscard]] auto rootLines() const -> std::span<const RootLine> {
+    return {lines.data(), lineCount};
   }
 
-  void appendZobristHistory() {
-    zobristHistory[zobristHistoryIndex] = board.zobrist;
-    zobristHistoryIndex = (zobristHistoryIndex + 1) % ZOBRIST_HISTORY_SIZE;
+  [[nodiscard]] auto principalVariation() const -> std::span<const MoveCTX> {
+    if (lineCount == 0) {
+      return {};
+    }
+    return {lines[0].moves.data(), lines[0].length};
   }
 
-  void clear() {
-    TT.clear();
+  // Number of threads used by iterative deepening, this one included. Every
+  // extra thread is a Lazy SMP helper with its own board, killers and history
+  void setThreads(std::uint32_t threads);
 
-    startingTime = 0;
-    endTime = UINT64_MAX;
+  [[nodiscard]] auto threadCount() const -> std::uint32_t {
+    return static_cast<std::uint32_t>(helpers.size()) + 1;
+  }
 
-    for (auto &depth : killers) {
-      depth.fill(MoveCTX());
+  void afterSearch() {
+    ageHeuristics();
+    for (const auto &helper : helpers) {
+      helper->ageHeuristics();
     }
+  }
 
-    zobristHistoryIndex = 0;
-    zobristHistory.fill(~0ULL);
+  // Forgets the game, `position` pushes it again from its first position
+  void clearKeys() { keyCount = 0; }
 
-    for (auto &color : history) {
-      for (auto &row : color) {
-        row.fill(0);
+  // Adds a position of the game being played. Nothing before an irreversible
+  // move can repeat, so those keys are dropped
+  void pushGameKey(const ChessBoard &position) {
+    if (position.halfmoveClock == 0) {
+      keyCount = 0;
+    }
+    if (keyCount == MAX_GAME_KEYS) {
+      std::copy(keyStack.begin() + 1, keyStack.begin() + keyCount,
+                keyStack.begin());
+      keyCount--;
+    }
+    pushKey(position.zobrist);
+  }
+
+  // Whether `position`, the last key pushed, is `ply` plies into the search
+  // and repeats an earlier position. Once is enough if the earlier one is in
+  // the search tree too, the side that allowed it can allow it again.
+  // Positions from the game before the root need two, as in the rules
+  [[nodiscard]] auto isRepetition(const ChessBoard &position,
+                                  const std::uint8_t ply) const -> bool {
+    assert(keyCount > 0 && keyStack[keyCount - 1] == position.zobrist);
+    const std::size_t reach =
+        std::min<std::size_t>(position.halfmoveClock, keyCount - 1);
+
+    // The same side is to move every other ply, and it takes four to get back
+    bool repeatedBeforeRoot = false;
+    for (std::size_t back = 4; back <= reach; back += 2) {
+      if (keyStack[keyCount - 1 - back] == position.zobrist) {
+        if (back < ply || repeatedBeforeRoot) {
+          return true;
+        }
+        repeatedBeforeRoot = true;
       }
     }
 
-    nodes = 0;
-    seldepth = 0;
+    return false;
+  }
+
+  void clear() {
+    TT.clear(threadCount());
+
+    startingTime = 0;
+    timeManager = TimeManager();
+
+    clearKeys();
+
+    resetHeuristics();
+    for (const auto &helper : helpers) {
+      helper->resetHeuristics();
+    }
   }
 
 private:
-  TranspositionTable TT;
+  TranspositionTable &TT;
+
+  std::atomic<bool> stopFlag = false;
+  std::atomic<bool> &stop;
+  std::atomic<bool> pondering = false;
 
-  std::uint8_t zobristHistoryIndex = 0;
-  std::uint64_t endTime = UINT64_MAX;
+  std::vector<std::unique_ptr<ChessBoard>> helperBoards;
+  std::vector<std::unique_ptr<Searching>> helpers;
+
+  // Only the main thread has limits. Its clock starts with the search, or at
+  // ponderhit() when pondering
+  TimeManager timeManager;
+  std::atomic<std::uint64_t> clockStart = 0;
   std::uint64_t startingTime = UINT64_MAX;
 
   std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> killers{};
-  std::array<std::uint64_t, ZOBRIST_HISTORY_SIZE> zobristHistory{};
+
+  // Triangular PV table: row `ply` holds the best line from `ply` on, in
+  // columns ply to pvLength[ply] - 1
+  std::array<std::array<MoveCTX, MAX_DEPTH + 1>, MAX_DEPTH + 1> pvTable{};
+  std::array<std::uint8_t, MAX_DEPTH + 2> pvLength{};
+
+  // Lines of the last finished iteration, and the ones the running one fills
+  // in. Each line is searched first again by its pass of the next iteration,
+  // for as long as the path is still on it
+  std::uint32_t multiPV = 1;
+  std::vector<RootLine> lines = std::vector<RootLine>(1);
+  std::vector<RootLine> nextLines = std::vector<RootLine>(1);
+  std::size_t lineCount = 0;
+  std::size_t followedLine = 0;
+  bool followPV = false;
+  // A fifty-move draw comes before a game could add more keys since its last
+  // irreversible move
+  static constexpr std::size_t MAX_GAME_KEYS = 128;
+
+  // Keys of the game since its last irreversible move, then of the search path
+  // down to the current node
+  std::array<std::uint64_t, MAX_GAME_KEYS + MAX_DEPTH + 2> keyStack{};
+  std::size_t keyCount = 0;
   std::array<std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
       history{};
 
@@ -186,25 +489,160 @@ private:
   [[nodiscard]] auto quiescence(std::int32_t alpha, std::int32_t beta,
                                std::uint8_t ply) -> std::int32_t;
 
-  void popZobristHistory() {
-    zobristHistoryIndex =
-        (zobristHistoryIndex + ZOBRIST_HISTORY_SIZE - 1) % ZOBRIST_HISTORY_SIZE;
-    zobristHistory[zobristHistoryIndex] = ~0ULL;
+  void helperSearch(std::uint8_t maxDepth, std::size_t helperIndex);
+
+  // `move` with the child's line behind it becomes the line at `ply`
+  void updatePV(const std::uint8_t ply, const MoveCTX &move) {
+    pvTable[ply][ply] = move;
+    for (std::uint8_t i = ply + 1; i < pvLength[ply + 1]; i++) {
+      pvTable[ply][i] = pvTable[ply + 1][i];
+    }
+    pvLength[ply] = std::max<std::uint8_t>(pvLength[ply + 1], ply + 1);
   }
 
-  struct ScopedUndo {
-    ChessBoard &board;
-    Searching &search;
-    const UndoCTX undo;
+  // A PV node that returns on a TT hit has no line of its own, the moves the
+  // table holds from there on stand in for it
+  void fillPVFromTT(std::uint8_t ply, std::uint8_t depth);
+
+  // Packed move of the previous line at `ply`, 0 once the path left it
+  [[nodiscard]] auto pvMoveAt(const std::uint8_t ply) -> std::uint16_t {
+    if (followPV && ply < lines[followedLine].length) {
+      return lines[followedLine].moves[ply].pack();
+    }
+    followPV = false;
+    return 0;
+  }
+
+  // The clock is read once every TIME_CHECK_INTERVAL nodes from countNode(),
+  // the search itself only loads the shared flag
+  static constexpr std::uint64_t TIME_CHECK_INTERVAL = 1024;
+  static_assert(std::has_single_bit(TIME_CHECK_INTERVAL));
+
+  [[nodiscard]] auto shouldStop() const -> bool {
+    return stop.load(std::memory_order_relaxed);
+  }
+
+  // Raises the stop flag for every thread once the main one is out of time
+  void checkTime();
 
-    ScopedUndo(ChessBoard &_board, const MoveCTX &_move, Searching &_search)
-        : board(_board), search(_search), undo(_move, _board) {
-      makeMove(board, _move);
-      search.appendZobristHistory();
+  // Release, so a thread that sees the end of pondering sees the new
+  // clockStart too
+  void endPondering() {
+    pondering.store(false, std::memory_order_release);
+    pondering.notify_all();
+  }
+
+  // Only the owning thread writes its counter, so a relaxed load/store pair is
+  // enough and avoids a locked increment on every node
+  void countNode() {
+    const std::uint64_t count = nodes.load(std::memory_order_relaxed) + 1;
+    nodes.store(count, std::memory_order_relaxed);
+    if ((count & (TIME_CHECK_INTERVAL - 1)) == 0) {
+      checkTime();
     }
-    ~ScopedUndo() {
-      undoMove(board, undo);
-      search.popZobristHistory();
+  }
+
+  [[nodiscard]] auto totalNodes() const -> std::uint64_t {
+    std::uint64_t result = nodes.load(std::memory_order_relaxed);
+    for (const auto &helper : helpers) {
+      result += helper->nodes.load(std::memory_order_relaxed);
     }
+    return result;
+  }
+
+  void ageHeuristics() {
+    auto reduceOldBonusColor = [&](const std::uint8_t forWhites) {
+      for (std::uint32_t fromSquare = 0; fromSquare < BOARD_AREA;
+           fromSquare++) {
+        for (std::uint32_t toSquare = 0; toSquare < BOARD_AREA; toSquare++) {
+          history[forWhites][fromSquare][toSquare] >>= 1;
+        }
+      }
+    };
+
+    reduceOldBonusColor(1);
+    reduceOldBonusColor(0);
+
+    for (auto &depth : killers) {
+      depth.fill(MoveCTX());
+    }
+
+    nodes = 0;
+    seldepth = 0;
+  }
+
+  void resetHeuristics() {
+    for (auto &depth : killers) {
+      depth.fill(MoveCTX());
+    }
+
+    for (auto &color : history) {
+      for (auto &row : color) {
+        row.fill(0);
+      }
+    }
+
+    nodes = 0;
+    seldepth = 0;
+  }
+
+  void pushKey(const std::uint64_t zobrist) {
+    assert(keyCount < keyStack.size());
+    keyStack[keyCount++] = zobrist;
+  }
+
+  void popKey() { keyCount--; }
+
+#ifdef COPY_MAKE
+  // Board of every ply past the root, each child is made on a fresh copy of
+  // its parent so nothing has to be taken back
+  std::array<ChessBoard, MAX_DEPTH + 2> boardStack{};
+#else
+  // Undo record of the move made at every ply
+  std::array<UndoCTX, MAX_DEPTH + 1> undoStack{};
+#endif
+
+  [[nodiscard]] auto boardAt(const std::uint8_t ply) -> ChessBoard & {
+#ifdef COPY_MAKE
+    if (ply > 0) {
+      return boardStack[ply];
+    }
+#endif
+    return board;
+  }
+
+  // Makes `move` from the board of `ply` for the child one ply deeper and
+  // takes it back when it goes out of scope
+  class ScopedMove {
+  public:
+    ScopedMove(Searching &_search, const std::uint8_t _ply, const MoveCTX &move)
+        : search(_search), child(_search.boardAt(_ply + 1)), ply(_ply) {
+#ifdef COPY_MAKE
+      child = search.boardAt(ply);
+#else
+      search.undoStack[ply] = UndoCTX(move, child);
+#endif
+      makeMove(child, move);
+      search.TT.prefetch(child.zobrist);
+      search.pushKey(child.zobrist);
+    }
+    ScopedMove(ScopedMove &&) = delete;
+    ScopedMove(const ScopedMove &) = delete;
+    auto operator=(ScopedMove &&) -> ScopedMove & = delete;
+    auto operator=(const ScopedMove &) -> ScopedMove & = delete;
+    ~ScopedMove() {
+#ifndef COPY_MAKE
+      undoMove(child, search.undoStack[ply]);
+#endif
+      search.popKey();
+    }
+
+    // The position after the move
+    [[nodiscard]] auto position() const -> const ChessBoard & { return child; }
+
+  private:
+    Searching &search;
+    ChessBoard &child;
+    std::uint8_t ply;
   };
 };
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "legalMoves.h"
+#include <cstdint>
+
+// How long one search may think. The soft limit is checked between
+// iterations: past it no new depth is started. The hard limit aborts the
+// search wherever it is. With a clock the soft limit moves with the search,
+// shorter when the best move keeps coming back and longer when it changes or
+// the score falls
+class TimeManager {
+public:
+  static constexpr std::uint64_t UNLIMITED = UINT64_MAX;
+
+  // Room left on the clock for the GUI and the pipe
+  static constexpr std::uint64_t MOVE_OVERHEAD_MS = 10;
+
+  // No limit, the search runs until its depth or a `stop`
+  TimeManager() = default;
+
+  // `go movetime`, the whole time is used and nothing is scaled
+  [[nodiscard]] static auto fixed(std::uint64_t moveTimeMs) -> TimeManager;
+
+  // `go wtime/btime`, `movesToGo` is zero in sudden death
+  [[nodiscard]] static auto fromClock(std::int64_t timeMs,
+                                      std::int64_t incrementMs,
+                                      std::uint32_t movesToGo) -> TimeManager;
+
+  [[nodiscard]] auto isLimited() const -> bool { return hard != UNLIMITED; }
+  [[nodiscard]] auto hardLimit() const -> std::uint64_t { return hard; }
+  [[nodiscard]] auto softLimit() const -> std::uint64_t;
+
+  // Called after every finished iteration with its best move and score
+  void update(const MoveCTX &bestMove, std::int32_t score);
+
+  // `elapsedMs` counts from the start of the clock
+  [[nodiscard]] auto shouldStartIteration(const std::uint64_t elapsedMs) const
+      -> bool {
+    return elapsedMs < softLimit();
+  }
+
+private:
+  // Where stability starts, before there is anything to compare with
+  static constexpr std::uint8_t NEUTRAL_STABILITY = 2;
+
+  std::uint64_t soft = UNLIMITED;
+  std::uint64_t hard = UNLIMITED;
+  bool scalable = false;
+
+  MoveCTX previousMove;
+  std::int32_t previousScore = 0;
+  std::uint8_t iterations = 0;
+  // Iterations in a row with the same best move
+  std::uint8_t stability = NEUTRAL_STABILITY;
+  std::uint32_t scorePercent = 100;
+};
@@ -3,13 +3,70 @@
 #include "bitboard.h"
 #include "sysifus.h"
 #include <array>
+#include <cstddef>
 #include <cstdint>
 
-extern std::array<
-    std::array<std::array<std::uint64_t, BOARD_AREA>, Piece::KING + 1>, 2>
-    ZOBRIST_PIECE;
-extern std::uint64_t ZOBRIST_TURN;
-extern std::array<std::uint64_t, 1 << 4> ZOBRIST_CASTLING_RIGHTS;
-extern std::array<std::uint64_t, BOARD_LENGTH> ZOBRIST_EN_PASSANT_FILE;
+// Fixed, so hashes (and hash files written by `save_hash`) are the same on
+// every run and every compiler
+static constexpr std::uint64_t ZOBRIST_SEED = 0x7A6E617468;
 
-static constexpr std::uint8_t ZOBRIST_HISTORY_SIZE = 6;
+// Key number `index` of a splitmix64 stream. It's counter based, so each table
+// below takes its own stretch of the stream and is built at compile time
+[[nodiscard]] constexpr auto zobristKey(const std::size_t index)
+    -> std::uint64_t {
+  std::uint64_t key = ZOBRIST_SEED + (index + 1) * 0x9E3779B97F4A7C15ULL;
+  key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+  return key ^ (key >> 31);
+}
+
+static constexpr std::size_t ZOBRIST_PIECE_KEYS =
+    2 * (Piece::KING + 1) * BOARD_AREA;
+static constexpr std::size_t ZOBRIST_TURN_INDEX = ZOBRIST_PIECE_KEYS;
+static constexpr std::size_t ZOBRIST_CASTLING_INDEX = ZOBRIST_TURN_INDEX + 1;
+static constexpr std::size_t ZOBRIST_EN_PASSANT_INDEX =
+    ZOBRIST_CASTLING_INDEX + (1 << 4);
+static constexpr std::size_t ZOBRIST_KEY_COUNT =
+    ZOBRIST_EN_PASSANT_INDEX + BOARD_LENGTH;
+
+static constexpr auto ZOBRIST_PIECE = [] {
+  std::array<std::array<std::array<std::uint64_t, BOARD_AREA>, Piece::KING + 1>,
+             2>
+      keys{};
+  std::size_t index = 0;
+  for (auto &color : keys) {
+    for (auto &pieceBitboard : color) {
+      for (std::uint64_t &zobrist : pieceBitboard) {
+        zobrist = zobristKey(index++);
+      }
+    }
+  }
+  return keys;
+}();
+
+static constexpr std::uint64_t ZOBRIST_TURN = zobristKey(ZOBRIST_TURN_INDEX);
+
+static constexpr auto ZOBRIST_CASTLING_RIGHTS = [] {
+  std::array<std::uint64_t, 1 << 4> keys{};
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    keys[i] = zobristKey(ZOBRIST_CASTLING_INDEX + i);
+  }
+  return keys;
+}();
+
+static constexpr auto ZOBRIST_EN_PASSANT_FILE = [] {
+  std::array<std::uint64_t, BOARD_LENGTH> keys{};
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    keys[i] = zobristKey(ZOBRIST_EN_PASSANT_INDEX + i);
+  }
+  return keys;
+}();
+
+// Hash of every key above, a TT written with other keys is useless
+static constexpr std::uint64_t ZOBRIST_SIGNATURE = [] {
+  std::uint64_t signature = 0;
+  for (std::size_t i = 0; i < ZOBRIST_KEY_COUNT; i++) {
+    signature = (signature ^ zobristKey(i)) * 0x9E3779B97F4A7C15ULL;
+  }
+  return signature;
+}();
@@ -7,13 +7,37 @@
 #include <cassert>
 #include <cstdint>
 
+void ChessBoard::updateOccupancy() {
+  whiteFlat = 0;
+  blackFlat = 0;
+  mailbox.fill(Piece::NOTHING);
+
+  for (std::uint32_t type = Piece::PAWN; type <= Piece::KING; type++) {
+    whiteFlat |= whites[type];
+    blackFlat |= blacks[type];
+
+    for (std::uint64_t pieces = whites[type] | blacks[type]; pieces != 0;
+         pieces &= pieces - 1) {
+      mailbox[std::countr_zero(pieces)] = static_cast<Piece>(type);
+    }
+  }
+
+  occupied = whiteFlat | blackFlat;
+}
+
+auto ChessBoard::isOccupancyInSync() const -> bool {
+  ChessBoard rebuilt = *this;
+  rebuilt.updateOccupancy();
+
+  return rebuilt.whiteFlat == whiteFlat && rebuilt.blackFlat == blackFlat &&
+         rebuilt.occupied == occupied && rebuilt.mailbox == mailbox;
+}
+
 auto ChessBoard::isSquareUnderAttack(const std::int32_t square,
                                      const bool byWhites) const -> bool {
   const std::array<std::uint64_t, Piece::KING + 1> &attackingSidePieces =
       byWhites ? this->whites : this->blacks;
 
-  const std::uint64_t flat = getFlat(true) | getFlat(false);
-
   const Coordinate coord = {.rank = static_cast<int8_t>(square / BOARD_LENGTH),
                             .file = static_cast<int8_t>(square % BOARD_LENGTH)};
 
@@ -37,9 +61,9 @@ auto ChessBoard::isSquareUnderAttack(const std::int32_t square,
   // attacks, so we combine friendly/enemy.
   std::uint64_t bishopAttacksFromSquare = getBishopAttackByOccupancy(
       static_cast<std::int8_t>(square),
-      0ULL, // This is a dummy 'friendly' because the piece is hypothetical on
-            // square
-      flat  // All occupied squares are blockers for sliders
+      0ULL,    // This is a dummy 'friendly' because the piece is hypothetical
+               // on square
+      occupied // All occupied squares are blockers for sliders
   );
   // Check if any actual enemy Bishop or Queen is on these attack lines
   if ((bishopAttacksFromSquare & (attackingSidePieces[Piece::BISHOP] |
@@ -50,8 +74,8 @@ auto ChessBoard::isSquareUnderAttack(const std::int32_t square,
   // --- Check for Rook/Queen attacks (Orthogonal Sliders) ---
   std::uint64_t rookAttacksFromSquare =
       getRookAttackByOccupancy(static_cast<std::int8_t>(square),
-                               0ULL, // Dummy 'friendly'
-                               flat  // All occupied squares are blockers
+                               0ULL,    // Dummy 'friendly'
+                               occupied // All occupied squares are blockers
       );
   // Check if any actual enemy Rook or Queen is on these attack lines
   if ((rookAttacksFromSquare & (attackingSidePieces[Piece::ROOK] |
@@ -128,30 +152,12 @@ auto ChessBoard::insufficientMaterial() const -> bool {
   return false;
 }
 
-auto ChessBoard::isDraw(
-    const std::array<std::uint64_t, ZOBRIST_HISTORY_SIZE> &zobristHistory) const
-    -> bool {
+auto ChessBoard::isDraw() const -> bool {
   static constexpr std::uint8_t fiftyMoveCounterThreshold = 100;
   if (halfmoveClock >= fiftyMoveCounterThreshold) {
     return true;
   }
 
-  if (zobristHistory.size() >= 3) {
-    std::uint8_t count = 0;
-    for (std::size_t i = zobristHistory.size() - 1;
-         i < zobristHistory.size() && i >= 0; --i) {
-      if (zobrist == ~0ULL) {
-        continue;
-      }
-
-      if (zobristHistory[i] == zobrist) {
-        count++;
-        if (count == 3) {
-          return true;
-        }
-      }
-    }
-  }
   if (insufficientMaterial()) {
     return true;
   }
@@ -1,13 +1,44 @@
 #include "legalMoves.h"
 #include "bitboard.h"
 #include "board.h"
+#include "luts.h"
 #include "sysifus.h" // for getPseudoLegal
 #include <algorithm>
+#include <array>
 #include <bit>
+#include <cassert>
 #include <cstdint>
 #include <cstdlib>
 
-void MoveGenerator::appendContext(MoveCTX &ctx, const bool forWhites) {
+// Squares strictly between two squares on a shared rank, file or diagonal, 0
+// if they don't share one
+static constexpr auto SQUARES_BETWEEN = [] {
+  std::array<std::array<std::uint64_t, BOARD_AREA>, BOARD_AREA> table{};
+
+  for (std::int32_t from = 0; from < BOARD_AREA; from++) {
+    for (std::int32_t to = 0; to < BOARD_AREA; to++) {
+      const std::int32_t rankDelta = to / BOARD_LENGTH - from / BOARD_LENGTH;
+      const std::int32_t fileDelta = to % BOARD_LENGTH - from % BOARD_LENGTH;
+      const bool isAligned =
+          from != to && (rankDelta == 0 || fileDelta == 0 ||
+                         rankDelta == fileDelta || rankDelta == -fileDelta);
+      if (!isAligned) {
+        continue;
+      }
+
+      const std::int32_t step = (rankDelta > 0) - (rankDelta < 0);
+      const std::int32_t fileStep = (fileDelta > 0) - (fileDelta < 0);
+      for (std::int32_t square = from + step * BOARD_LENGTH + fileStep;
+           square != to; square += step * BOARD_LENGTH + fileStep) {
+        table[from][to] |= 1ULL << square;
+      }
+    }
+  }
+
+  return table;
+}();
+
+void MoveGenerator::fillCapture(MoveCTX &ctx, const bool forWhites) const {
   // Determine the captured square and captured piece
   const std::int32_t capturedPawnSquare =
       forWhites ? board.enPassantSquare - BOARD_LENGTH
@@ -26,19 +57,14 @@ void MoveGenerator::appendContext(MoveCTX &ctx, const bool forWhites) {
     ctx.to = board.enPassantSquare;
     ctx.captured = Piece::PAWN;
   } else if ((enemyFlat & toBit) != 0) {
-    const auto &enemyColor = forWhites ? board.blacks : board.whites;
-
-    // Handle regular captures
-    for (std::uint32_t enemyType = Piece::PAWN; enemyType <= Piece::KING;
-         enemyType++) {
-      if ((enemyColor[enemyType] & toBit) != 0) {
-        ctx.captured = static_cast<Piece>(enemyType);
-        break;
-      }
-    }
+    ctx.captured = board.mailbox[ctx.to];
   } else {
     ctx.captured = Piece::NOTHING;
   }
+}
+
+void MoveGenerator::appendContext(MoveCTX &ctx, const bool forWhites) {
+  fillCapture(ctx, forWhites);
 
   const auto toRank = static_cast<std::int8_t>(ctx.to / BOARD_LENGTH);
   const std::int8_t promotionRank = forWhites ? 7 : 0;
@@ -47,15 +73,15 @@ void MoveGenerator::appendContext(MoveCTX &ctx, const bool forWhites) {
     for (std::uint32_t promotion = Piece::KNIGHT; promotion <= Piece::QUEEN;
          promotion++) {
       ctx.promotion = static_cast<Piece>(promotion);
-      pseudoLegal.push_back(ctx);
+      moves.push_back(ctx);
     }
   } else {
-    pseudoLegal.push_back(ctx);
+    moves.push_back(ctx);
   }
 }
 
-void MoveGenerator::generatePseudoLegal(const bool onlyKills,
-                                        const bool forWhites) {
+void MoveGenerator::generate(const GenerationType generationType,
+                             const bool forWhites) {
   const auto &color = forWhites ? board.whites : board.blacks;
 
   friendlyFlat = board.getFlat(forWhites);
@@ -72,7 +98,7 @@ void MoveGenerator::generatePseudoLegal(const bool onlyKills,
               ? enemyFlat | (1ULL << board.enPassantSquare)
               : enemyFlat;
       Move pseudoLegalMoves = (Move){0, 0};
-      if (onlyKills) {
+      if (generationType == GenerationType::KILLS) {
         pseudoLegalMoves.kills =
             getKills(static_cast<Piece>(type), fromSquare, friendlyFlat,
                      forWhites, enemyFlatWithEnPassant);
@@ -80,6 +106,9 @@ void MoveGenerator::generatePseudoLegal(const bool onlyKills,
         pseudoLegalMoves =
             getPseudoLegal(static_cast<Piece>(type), fromSquare, friendlyFlat,
                            forWhites, enemyFlatWithEnPassant);
+        if (generationType == GenerationType::QUIETS) {
+          pseudoLegalMoves.kills = 0;
+        }
       }
 
       std::uint64_t pseudoLegalBits =
@@ -106,6 +135,296 @@ void MoveGenerator::generatePseudoLegal(const bool onlyKills,
   }
 }
 
+auto MoveGenerator::unpack(const std::uint16_t packed, const bool forWhites,
+                           MoveCTX &outMove) -> bool {
+  static constexpr std::uint16_t SQUARE_MASK = 0x3F;
+  static constexpr std::uint16_t PROMOTION_MASK = 0x7;
+
+  const auto from = static_cast<std::int8_t>(packed & SQUARE_MASK);
+  const auto to = static_cast<std::uint32_t>((packed >> 6) & SQUARE_MASK);
+  const auto promotion = static_cast<Piece>((packed >> 12) & PROMOTION_MASK);
+
+  if ((board.getFlat(forWhites) & (1ULL << from)) == 0) {
+    return false;
+  }
+  const Piece original = board.mailbox[from];
+
+  friendlyFlat = board.getFlat(forWhites);
+  enemyFlat = board.getFlat(!forWhites);
+  const std::uint64_t enemyFlatWithEnPassant =
+      original == Piece::PAWN && board.enPassantSquare != 0
+          ? enemyFlat | (1ULL << board.enPassantSquare)
+          : enemyFlat;
+  const Move pseudoLegalMoves = getPseudoLegal(
+      original, from, friendlyFlat, forWhites, enemyFlatWithEnPassant);
+  if (((pseudoLegalMoves.quiet | pseudoLegalMoves.kills) & (1ULL << to)) ==
+      0) {
+    return false;
+  }
+
+  // Promotions have to name a piece and nothing else can
+  const bool isPromotion =
+      original == Piece::PAWN && to / BOARD_LENGTH == (forWhites ? 7U : 0U);
+  const bool namesPiece =
+      promotion >= Piece::KNIGHT && promotion <= Piece::QUEEN;
+  if (isPromotion != namesPiece) {
+    return false;
+  }
+
+  outMove = {
+      .from = static_cast<std::uint32_t>(from),
+      .to = to,
+      .capturedSquare = 0,
+      .original = original,
+      .captured = Piece::NOTHING,
+      .promotion = isPromotion ? promotion : Piece::NOTHING,
+  };
+  fillCapture(outMove, forWhites);
+  return true;
+}
+
+void MoveGenerator::analyzeKing(const bool forWhites) {
+  const auto &color = forWhites ? board.whites : board.blacks;
+  const auto &enemyColor = forWhites ? board.blacks : board.whites;
+
+  friendlyFlat = board.getFlat(forWhites);
+  enemyFlat = board.getFlat(!forWhites);
+  analyzedForWhites = forWhites;
+  analyzed = true;
+
+  const std::uint64_t occupancy = friendlyFlat | enemyFlat;
+  kingSquare = std::countr_zero(color[Piece::KING]);
+  const auto king = static_cast<std::int8_t>(kingSquare);
+  const Coordinate coord = {
+      .rank = static_cast<std::int8_t>(kingSquare / BOARD_LENGTH),
+      .file = static_cast<std::int8_t>(kingSquare % BOARD_LENGTH)};
+
+  const std::uint64_t diagonalSliders =
+      enemyColor[Piece::BISHOP] | enemyColor[Piece::QUEEN];
+  const std::uint64_t orthogonalSliders =
+      enemyColor[Piece::ROOK] | enemyColor[Piece::QUEEN];
+
+  checkers =
+      generatePawnCaptures(coord, enemyColor[Piece::PAWN], forWhites) |
+      (KNIGHT_ATTACK_MAP[kingSquare] & enemyColor[Piece::KNIGHT]) |
+      (getBishopAttackByOccupancy(king, 0ULL, occupancy) & diagonalSliders) |
+      (getRookAttackByOccupancy(king, 0ULL, occupancy) & orthogonalSliders);
+
+  if (checkers == 0) {
+    checkMask = ~0ULL;
+  } else if (std::has_single_bit(checkers)) {
+    checkMask = SQUARES_BETWEEN[kingSquare][std::countr_zero(checkers)] |
+                checkers;
+  } else {
+    checkMask = 0;
+  }
+
+  // Sliders that would hit the king on an empty board pin the only piece
+  // between them, if it's a friendly one
+  pinned = 0;
+  std::uint64_t snipers =
+      (getBishopAttackByOccupancy(king, 0ULL, 0ULL) & diagonalSliders) |
+      (getRookAttackByOccupancy(king, 0ULL, 0ULL) & orthogonalSliders);
+  while (snipers != 0) {
+    const std::uint32_t sniper = std::countr_zero(snipers);
+    const std::uint64_t between = SQUARES_BETWEEN[kingSquare][sniper];
+    const std::uint64_t blockers = between & occupancy;
+
+    if (std::has_single_bit(blockers) && (blockers & friendlyFlat) != 0) {
+      pinned |= blockers;
+      pinRays[std::countr_zero(blockers)] = between | (1ULL << sniper);
+    }
+
+    snipers &= snipers - 1;
+  }
+}
+
+auto MoveGenerator::isAttacked(const std::uint32_t square,
+                               const std::uint64_t occupancy) const -> bool {
+  const auto &enemyColor = analyzedForWhites ? board.blacks : board.whites;
+  const auto target = static_cast<std::int8_t>(square);
+  const Coordinate coord = {
+      .rank = static_cast<std::int8_t>(square / BOARD_LENGTH),
+      .file = static_cast<std::int8_t>(square % BOARD_LENGTH)};
+
+  // Pieces missing from `occupancy` were captured and attack nothing
+  const std::uint64_t attackers =
+      generatePawnCaptures(coord, enemyColor[Piece::PAWN], analyzedForWhites) |
+      (KNIGHT_ATTACK_MAP[square] & enemyColor[Piece::KNIGHT]) |
+      (getBishopAttackByOccupancy(target, 0ULL, occupancy) &
+       (enemyColor[Piece::BISHOP] | enemyColor[Piece::QUEEN])) |
+      (getRookAttackByOccupancy(target, 0ULL, occupancy) &
+       (enemyColor[Piece::ROOK] | enemyColor[Piece::QUEEN])) |
+      (KING_ATTACK_MAP[square] & enemyColor[Piece::KING]);
+
+  return (attackers & occupancy) != 0;
+}
+
+// En passant removes two pieces from one rank, which can uncover a check no
+// pin mask sees, so the resulting position is checked directly
+auto MoveGenerator::isEnPassantLegal(const std::uint32_t from) const -> bool {
+  const std::uint32_t to = board.enPassantSquare;
+  const std::uint32_t capturedSquare =
+      analyzedForWhites ? to - BOARD_LENGTH : to + BOARD_LENGTH;
+  const std::uint64_t occupancy =
+      ((friendlyFlat | enemyFlat) & ~(1ULL << from) &
+       ~(1ULL << capturedSquare)) |
+      (1ULL << to);
+
+  return !isAttacked(kingSquare, occupancy);
+}
+
+auto MoveGenerator::isLegal(const MoveCTX &move) const -> bool {
+  assert(analyzed);
+
+  if (move.original == Piece::KING) {
+    return !isAttacked(move.to,
+                       (friendlyFlat | enemyFlat) & ~(1ULL << move.from));
+  }
+
+  if (move.capturedSquare != move.to) {
+    return isEnPassantLegal(move.from);
+  }
+
+  const std::uint64_t toBit = 1ULL << move.to;
+  if ((checkMask & toBit) == 0) {
+    return false;
+  }
+
+  return (pinned & (1ULL << move.from)) == 0 ||
+         (pinRays[move.from] & toBit) != 0;
+}
+
+void MoveGenerator::appendLegalKingMoves(const GenerationType generationType) {
+  const auto king = static_cast<std::int8_t>(kingSquare);
+  // The king can't hide behind itself from a slider
+  const std::uint64_t occupancy =
+      (friendlyFlat | enemyFlat) & ~(1ULL << kingSquare);
+
+  std::uint64_t targets = 0;
+  if (generationType == GenerationType::KILLS) {
+    targets = getKills(Piece::KING, king, friendlyFlat, analyzedForWhites,
+                       enemyFlat);
+  } else {
+    const Move kingMoves = getPseudoLegal(Piece::KING, king, friendlyFlat,
+                                          analyzedForWhites, enemyFlat);
+    targets = generationType == GenerationType::QUIETS
+                  ? kingMoves.quiet
+                  : kingMoves.quiet | kingMoves.kills;
+  }
+
+  while (targets != 0) {
+    const std::uint32_t to = std::countr_zero(targets);
+    if (!isAttacked(to, occupancy)) {
+      MoveCTX ctx = {
+          .from = kingSquare,
+          .to = to,
+          .capturedSquare = 0,
+          .original = Piece::KING,
+          .captured = Piece::NOTHING,
+          .promotion = Piece::NOTHING,
+      };
+      appendContext(ctx, analyzedForWhites);
+    }
+
+    targets &= targets - 1;
+  }
+}
+
+void MoveGenerator::appendLegalMoves(const GenerationType generationType,
+                                     const std::uint64_t targetMask) {
+  const auto &color = analyzedForWhites ? board.whites : board.blacks;
+  const std::uint64_t enPassantBit =
+      board.enPassantSquare != 0 ? 1ULL << board.enPassantSquare : 0;
+
+  for (std::uint32_t type = Piece::PAWN; type < Piece::KING; type++) {
+    std::uint64_t typeBitboard = color[type];
+
+    while (typeBitboard != 0) {
+      const auto fromSquare =
+          static_cast<std::int8_t>(std::countr_zero(typeBitboard));
+      const std::uint64_t enemyFlatWithEnPassant =
+          type == Piece::PAWN ? enemyFlat | enPassantBit : enemyFlat;
+
+      std::uint64_t targets = 0;
+      if (generationType == GenerationType::KILLS) {
+        targets = getKills(static_cast<Piece>(type), fromSquare, friendlyFlat,
+                           analyzedForWhites, enemyFlatWithEnPassant);
+      } else {
+        const Move pieceMoves =
+            getPseudoLegal(static_cast<Piece>(type), fromSquare, friendlyFlat,
+                           analyzedForWhites, enemyFlatWithEnPassant);
+        targets = generationType == GenerationType::QUIETS
+                      ? pieceMoves.quiet
+                      : pieceMoves.quiet | pieceMoves.kills;
+      }
+
+      MoveCTX ctx = {
+          .from = static_cast<std::uint32_t>(fromSquare),
+          .to = 0,
+          .capturedSquare = 0,
+          .original = static_cast<Piece>(type),
+          .captured = Piece::NOTHING,
+          .promotion = Piece::NOTHING,
+      };
+
+      if (type == Piece::PAWN && (targets & enPassantBit) != 0) {
+        targets &= ~enPassantBit;
+        if (isEnPassantLegal(ctx.from)) {
+          ctx.to = board.enPassantSquare;
+          appendContext(ctx, analyzedForWhites);
+        }
+      }
+
+      targets &= targetMask;
+      if ((pinned & (1ULL << fromSquare)) != 0) {
+        targets &= pinRays[fromSquare];
+      }
+
+      while (targets != 0) {
+        ctx.to = std::countr_zero(targets);
+        ctx.promotion = Piece::NOTHING;
+        appendContext(ctx, analyzedForWhites);
+
+        targets &= targets - 1;
+      }
+
+      typeBitboard &= typeBitboard - 1;
+    }
+  }
+}
+
+// In check only the king may move, or in single check any piece that
+// captures the checker or blocks its ray
+void MoveGenerator::generateEvasions(const GenerationType generationType) {
+  appendLegalKingMoves(generationType);
+
+  if (!std::has_single_bit(checkers)) {
+    return;
+  }
+
+  appendLegalMoves(generationType, checkMask);
+}
+
+void MoveGenerator::generateLegal(const GenerationType generationType,
+                                  const bool forWhites) {
+  if (!analyzed || analyzedForWhites != forWhites) {
+    analyzeKing(forWhites);
+  }
+
+  if (checkers != 0) {
+    generateEvasions(generationType);
+    return;
+  }
+
+  appendLegalMoves(generationType, ~0ULL);
+  appendLegalKingMoves(generationType);
+
+  if (generationType != GenerationType::KILLS) {
+    appendCastling(board, forWhites);
+  }
+}
+
 static auto checkCastlingPath(const std::uint64_t piecePath,
                               const std::array<std::int32_t, 3> &attackPath,
                               const std::uint64_t flatBoard, const bool isBlack,
@@ -196,7 +515,7 @@ void MoveGenerator::appendCastling(const ChessBoard &board,
   while (castleMask != 0) {
     ctx.to = std::countr_zero(castleMask);
 
-    pseudoLegal.push_back(ctx);
+    moves.push_back(ctx);
 
     castleMask &= castleMask - 1;
   }
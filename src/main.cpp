@@ -3,11 +3,17 @@
 #include "move.h"
 #include "perft.h"
 #include "searching.h"
+#include "timeManager.h"
 #include <algorithm>
+#include <charconv>
 #include <cstddef>
 #include <iostream>
+#include <new>
+#include <optional>
+#include <span>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 auto tokenize(std::string &input) -> std::vector<std::string> {
@@ -25,7 +31,143 @@ auto tokenize(std::string &input) -> std::vector<std::string> {
 class UCI {
 private:
   ChessBoard board;
-  Searching searcher = Searching(board);
+  TranspositionTable TT;
+  Searching searcher = Searching(board, TT);
+  std::string hashFile; // Where save_hash and load_hash go
+  std::size_t perftHashMb = 0; // Zero runs perft without a table
+  std::uint32_t perftThreads = 1;
+  bool infiniteSearch = false;
+
+  // Declared last so it is joined before the board and searcher go away
+  std::jthread searchThread;
+
+  void printHashBacking() const {
+    std::cout << "info string Hash " << TT.size() * sizeof(TTCluster) / 1048576
+              << " MB backed by " << TT.backingName() << '\n';
+  }
+
+  void setOption(const std::vector<std::string> &tokens) {
+    // setoption name <id> [value <x>]
+    std::string name;
+    std::string value;
+    std::size_t index = 1;
+    if (index < tokens.size() && tokens[index] == "name") {
+      for (index++; index < tokens.size() && tokens[index] != "value";
+           index++) {
+        name += (name.empty() ? "" : " ") + tokens[index];
+      }
+    }
+    if (index < tokens.size() && tokens[index] == "value") {
+      for (index++; index < tokens.size(); index++) {
+        value += (value.empty() ? "" : " ") + tokens[index];
+      }
+    }
+
+    if (name == "Threads") {
+      try {
+        // Clamped before narrowing, or 2^32 + 1 would come out as 1
+        const unsigned long threads =
+            std::clamp<unsigned long>(std::stoul(value), 1, MAX_THREADS);
+        searcher.setThreads(static_cast<std::uint32_t>(threads));
+      } catch (const std::exception &e) {
+        std::cout << "info string Invalid Threads value\n";
+      }
+    } else if (name == "MultiPV") {
+      try {
+        searcher.setMultiPV(std::stoul(value));
+      } catch (const std::exception &e) {
+        std::cout << "info string Invalid MultiPV value\n";
+      }
+    } else if (name == "Hash") {
+      // `stoull` would take "-1" as the largest value and "64abc" as 64
+      std::size_t megabytes = 0;
+      const char *end = value.data() + value.size();
+      const auto [parsed, error] =
+          std::from_chars(value.data(), end, megabytes);
+      if (error != std::errc{} || parsed != end) {
+        std::cout << "info string Invalid Hash value\n";
+        return;
+      }
+
+      megabytes = std::clamp(megabytes, TranspositionTable::MIN_SIZE_MB,
+                             TranspositionTable::MAX_SIZE_MB);
+      try {
+        TT.resize(megabytes, searcher.threadCount());
+        printHashBacking();
+      } catch (const std::bad_alloc &e) {
+        // resize() leaves the old table in place, say which one is still used
+        std::cout << "info string Could not allocate " << megabytes
+                  << " MB, keeping the old table\n";
+        printHashBacking();
+      }
+    } else if (name == "Clear Hash") {
+      TT.clear(searcher.threadCount());
+    } else if (name == "PerftThreads") {
+      try {
+        const unsigned long threads =
+            std::clamp<unsigned long>(std::stoul(value), 1, MAX_THREADS);
+        perftThreads = static_cast<std::uint32_t>(threads);
+      } catch (const std::exception &e) {
+        std::cout << "info string Invalid PerftThreads value\n";
+      }
+    } else if (name == "PerftHash") {
+      try {
+        perftHashMb = std::min<std::size_t>(std::stoull(value),
+                                            PerftTable::MAX_SIZE_MB);
+      } catch (const std::exception &e) {
+        std::cout << "info string Invalid PerftHash value\n";
+      }
+    } else if (name == "HashFile") {
+      hashFile = value == "<empty>" ? "" : value;
+    } else if (name == "Ponder") {
+      // Only tells us the GUI may send `go ponder`, nothing to set up
+    } else {
+      std::cout << "info string Unknown option " << name << '\n';
+    }
+  }
+
+  void saveHash() const {
+    if (hashFile.empty()) {
+      std::cout << "info string HashFile is not set\n";
+    } else if (TT.save(hashFile)) {
+      std::cout << "info string Hash saved to " << hashFile << '\n';
+    } else {
+      std::cout << "info string Could not save hash to " << hashFile << '\n';
+    }
+  }
+
+  void loadHash() {
+    if (hashFile.empty()) {
+      std::cout << "info string HashFile is not set\n";
+    } else if (TT.load(hashFile)) {
+      printHashBacking();
+    } else {
+      std::cout << "info string Could not load hash from " << hashFile << '\n';
+    }
+  }
+
+  [[nodiscard]] auto perftTable() const -> std::optional<PerftTable> {
+    if (perftHashMb == 0) {
+      return std::nullopt;
+    }
+    return PerftTable(perftHashMb);
+  }
+
+  void runPerftSuite(const std::vector<std::string> &tokens) const {
+    // perftsuite [max depth]
+    std::uint8_t maxDepth = 0;
+    if (tokens.size() > 1) {
+      try {
+        maxDepth = std::stoi(tokens[1]);
+      } catch (const std::exception &e) {
+        std::cout << "info string Invalid depth\n";
+        return;
+      }
+    }
+
+    std::optional<PerftTable> table = perftTable();
+    perftSuite(maxDepth, perftThreads, table ? &*table : nullptr);
+  }
 
   void setPosition(std::vector<std::string> &tokens) {
     if (tokens.size() < 2) {
@@ -51,10 +193,13 @@ private:
       board = ChessBoard(fen);
     }
 
+    searcher.clearKeys();
+    searcher.pushGameKey(board);
+
     if (index < tokens.size() && tokens[index] == "moves") {
       for (std::size_t j = index + 1; j < tokens.size(); j++) {
         makeMove(board, fromAlgebraic(tokens[j], board));
-        searcher.appendZobristHistory();
+        searcher.pushGameKey(board);
       }
     }
   }
@@ -63,14 +208,14 @@ private:
     std::uint64_t timeLimitMs = 0;
     std::uint8_t depth = 0;
     bool isPerft = false;
+    bool ponder = false;
+    bool infinite = false;
 
-    static constexpr std::int32_t MIN_MOVES_TO_GO = 30;
-
-    std::int32_t wtime = 0;
-    std::int32_t btime = 0;
-    std::int32_t winc = 0;
-    std::int32_t binc = 0;
-    std::int32_t movesToGo = MIN_MOVES_TO_GO;
+    std::int64_t wtime = 0;
+    std::int64_t btime = 0;
+    std::int64_t winc = 0;
+    std::int64_t binc = 0;
+    std::uint32_t movesToGo = 0; // Sudden death unless the GUI says otherwise
 
     for (std::size_t i = 1; i < tokens.size(); ++i) {
       if (tokens[i] == "perft" && i + 1 < tokens.size()) {
@@ -100,48 +245,68 @@ private:
           return;
         }
       } else if (tokens[i] == "wtime" && i + 1 < tokens.size()) {
-        wtime = std::stoi(tokens[i + 1]);
+        wtime = std::stoll(tokens[i + 1]);
       } else if (tokens[i] == "btime" && i + 1 < tokens.size()) {
-        btime = std::stoi(tokens[i + 1]);
+        btime = std::stoll(tokens[i + 1]);
       } else if (tokens[i] == "winc" && i + 1 < tokens.size()) {
-        winc = std::stoi(tokens[i + 1]);
+        winc = std::stoll(tokens[i + 1]);
       } else if (tokens[i] == "binc" && i + 1 < tokens.size()) {
-        binc = std::stoi(tokens[i + 1]);
+        binc = std::stoll(tokens[i + 1]);
       } else if (tokens[i] == "movestogo" && i + 1 < tokens.size()) {
-        movesToGo = std::stoi(tokens[i + 1]);
+        movesToGo = std::stoul(tokens[i + 1]);
+      } else if (tokens[i] == "ponder") {
+        ponder = true;
+      } else if (tokens[i] == "infinite") {
+        infinite = true;
       }
     }
 
-    if (timeLimitMs == 0 && (wtime > 0 || btime > 0)) {
-      std::int32_t myTime = board.whiteToMove ? wtime : btime;
-      std::int32_t myInc = board.whiteToMove ? winc : binc;
-      movesToGo = std::max(MIN_MOVES_TO_GO, movesToGo);
+    if (isPerft) {
+      std::optional<PerftTable> table = perftTable();
+      const std::uint64_t nodes = parallelPerft(
+          depth, board, true, perftThreads, table ? &*table : nullptr);
+
+      std::cout << "Nodes searched: " << nodes << '\n';
+      return;
+    }
 
-      timeLimitMs = myTime / (movesToGo + 2) + myInc * 2 / 3;
+    // A depth limit searches to that depth whatever the clock says
+    TimeManager time;
+    if (depth == 0 && timeLimitMs > 0) {
+      time = TimeManager::fixed(timeLimitMs);
+    } else if (depth == 0 && (wtime > 0 || btime > 0)) {
+      time = board.whiteToMove ? TimeManager::fromClock(wtime, winc, movesToGo)
+                               : TimeManager::fromClock(btime, binc, movesToGo);
+    }
 
-      static constexpr std::uint64_t MIN_TIME_LIMIT = 10;
-      timeLimitMs = std::max<uint64_t>(timeLimitMs, MIN_TIME_LIMIT);
-      timeLimitMs = std::min<uint64_t>(timeLimitMs, myTime / 2);
+    if (depth == 0 && !time.isLimited() && !infinite && !ponder) {
+      std::cout << "info string No search parameters provided\n";
+      return;
     }
 
-    if (depth > 0) {
-      if (isPerft) {
-        const std::uint64_t nodes = perft(depth, board, true);
+    const std::uint8_t maxDepth = depth > 0 ? depth : MAX_SEARCHING_DEPTH - 1;
+    infiniteSearch = infinite;
+
+    // Before the thread starts, so a `stop` read right after this is kept
+    searcher.prepareSearch(ponder || infinite);
+    searchThread = std::jthread([this, time, maxDepth] {
+      const MoveCTX bestMove = searcher.iterativeDeepening(time, maxDepth);
 
-        std::cout << "Nodes searched: " << nodes << '\n';
-      } else {
-        auto [bestMove, _bestScore] = searcher.search(depth);
-        std::cout << "bestmove " << moveToUCI(bestMove) << "\n";
-        searcher.afterSearch();
+      // The reply the line expects is what the GUI lets us ponder on. A
+      // search stopped before its first iteration has no line to take it from
+      std::string output = "bestmove " + moveToUCI(bestMove);
+      const std::span<const MoveCTX> line = searcher.principalVariation();
+      if (line.size() >= 2 && line[0] == bestMove) {
+        output += " ponder " + moveToUCI(line[1]);
       }
-    } else if (timeLimitMs > 0) {
-      // If a time limit is specified, use iterative deepening
-      const MoveCTX bestMove = searcher.iterativeDeepening(timeLimitMs);
-      std::cout << "bestmove " << moveToUCI(bestMove) << "\n";
-    } else {
-      // Default behavior if no specific time or depth is given
-      // You might want to implement a default search or handle this case
-      std::cout << "info string No search parameters provided\n";
+      std::cout << output + '\n' << std::flush;
+    });
+  }
+
+  // Every command that touches the board or the searcher waits for this
+  void waitForSearch() {
+    if (searchThread.joinable()) {
+      searchThread.join();
     }
   }
 
@@ -159,21 +324,60 @@ public:
       if (tokens[0] == "uci") {
         std::cout << "id name Tanathos\n";
         std::cout << "id author P1x3r\n";
+        std::cout << "option name Hash type spin default "
+                  << TranspositionTable::DEFAULT_SIZE_MB << " min "
+                  << TranspositionTable::MIN_SIZE_MB << " max "
+                  << TranspositionTable::MAX_SIZE_MB << '\n';
+        std::cout << "option name Clear Hash type button\n";
+        std::cout << "option name HashFile type string default <empty>\n";
+        std::cout << "option name PerftHash type spin default 0 min 0 max "
+                  << PerftTable::MAX_SIZE_MB << '\n';
+        std::cout << "option name PerftThreads type spin default 1 min 1 max "
+                  << MAX_THREADS << '\n';
+        std::cout << "option name Threads type spin default 1 min 1 max "
+                  << MAX_THREADS << '\n';
+        std::cout << "option name MultiPV type spin default 1 min 1 max "
+                  << MAX_MOVES_IN_A_POSITION << '\n';
+        std::cout << "option name Ponder type check default false\n";
+        printHashBacking();
         std::cout << "uciok\n";
       } else if (tokens[0] == "isready") {
-        std::cout << "readyok\n";
+        // Answered at once, even in the middle of a search
+        std::cout << "readyok\n" << std::flush;
+      } else if (tokens[0] == "stop") {
+        searcher.requestStop();
+      } else if (tokens[0] == "ponderhit") {
+        infiniteSearch = false;
+        searcher.ponderhit();
+      } else if (tokens[0] == "quit") {
+        searcher.requestStop();
+        break;
+        // The commands above act on a running search, the ones below wait
+        // for it to end
+      } else if (waitForSearch(); tokens[0] == "setoption") {
+        setOption(tokens);
       } else if (tokens[0] == "position") {
         setPosition(tokens);
       } else if (tokens[0] == "go") {
         go(tokens);
+      } else if (tokens[0] == "perftsuite") {
+        runPerftSuite(tokens);
+      } else if (tokens[0] == "save_hash") {
+        saveHash();
+      } else if (tokens[0] == "load_hash") {
+        loadHash();
       } else if (tokens[0] == "ucinewgame") {
         board = ChessBoard(
             "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
         searcher.clear();
-      } else if (tokens[0] == "quit") {
-        break;
       }
     }
+
+    // Input ran out: a bounded search still gets to finish and print its move
+    if (infiniteSearch || searcher.isPondering()) {
+      searcher.requestStop();
+    }
+    waitForSearch();
   }
 };
 
@@ -4,6 +4,7 @@
 #include "legalMoves.h"
 #include "sysifus.h"
 #include "zobrist.h"
+#include <bit>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
@@ -25,7 +26,11 @@ moveRookIfCastling(std::array<std::uint64_t, Piece::KING + 1> &color,
     toRook = isKingSide ? BoardSquare::F8 : BoardSquare::D8;
   }
 
-  color[Piece::ROOK] ^= (1ULL << fromRook) | (1ULL << toRook);
+  const std::uint64_t rookMove = (1ULL << fromRook) | (1ULL << toRook);
+  color[Piece::ROOK] ^= rookMove;
+  (board.whiteToMove ? board.whiteFlat : board.blackFlat) ^= rookMove;
+  board.mailbox[fromRook] = Piece::NOTHING;
+  board.mailbox[toRook] = Piece::ROOK;
   board.zobrist ^= ZOBRIST_PIECE[board.whiteToMove][Piece::ROOK][fromRook] ^
                    ZOBRIST_PIECE[board.whiteToMove][Piece::ROOK][toRook];
 }
@@ -40,6 +45,8 @@ void movePieceToDestination(ChessBoard &board, const MoveCTX &ctx) {
       ctx.promotion != Piece::NOTHING ? ctx.promotion : ctx.original;
 
   color[final] |= 1ULL << ctx.to;
+  (board.whiteToMove ? board.whiteFlat : board.blackFlat) ^=
+      (1ULL << ctx.from) | (1ULL << ctx.to);
 
   board.zobrist ^= ZOBRIST_PIECE[board.whiteToMove][ctx.original][ctx.from] ^
                    ZOBRIST_PIECE[board.whiteToMove][final][ctx.to];
@@ -55,10 +62,18 @@ void movePieceToDestination(ChessBoard &board, const MoveCTX &ctx) {
         board.whiteToMove ? board.blacks : board.whites;
 
     enemyColor[ctx.captured] &= ~(1ULL << ctx.capturedSquare);
+    (board.whiteToMove ? board.blackFlat : board.whiteFlat) &=
+        ~(1ULL << ctx.capturedSquare);
+    board.mailbox[ctx.capturedSquare] = Piece::NOTHING;
 
     board.zobrist ^= ZOBRIST_PIECE[static_cast<std::size_t>(!board.whiteToMove)]
                                   [ctx.captured][ctx.capturedSquare];
   }
+
+  // After the capture, which shares the square unless it's en passant
+  board.mailbox[ctx.from] = Piece::NOTHING;
+  board.mailbox[ctx.to] = final;
+  board.occupied = board.whiteFlat | board.blackFlat;
 }
 
 static void updateEnPassantSquare(ChessBoard &board, const MoveCTX &ctx) {
@@ -152,13 +167,15 @@ void makeMove(ChessBoard &board, const MoveCTX &ctx) {
 
   board.zobrist ^= ZOBRIST_TURN;
   board.whiteToMove = !board.whiteToMove;
+  assert(board.isOccupancyInSync());
 }
 
 static void restoreByUndoCTX(ChessBoard &board, const UndoCTX &ctx) {
   board.zobrist = ctx.zobrist;
   board.halfmoveClock = ctx.halfmoveClock;
   board.enPassantSquare = ctx.enPassantSquare;
-  board.castlingRights = ctx.castlingRights;
+  board.castlingRights = std::bit_cast<CastlingRights>(
+      static_cast<std::uint8_t>(ctx.castlingRights));
   board.whiteToMove = !board.whiteToMove;
 }
 
@@ -178,7 +195,11 @@ restoreRookPositionIfCastling(std::array<std::uint64_t, Piece::KING + 1> &color,
     toRook = isKingSide ? BoardSquare::F8 : BoardSquare::D8;
   }
 
-  color[Piece::ROOK] ^= (1ULL << fromRook) | (1ULL << toRook);
+  const std::uint64_t rookMove = (1ULL << fromRook) | (1ULL << toRook);
+  color[Piece::ROOK] ^= rookMove;
+  (board.whiteToMove ? board.whiteFlat : board.blackFlat) ^= rookMove;
+  board.mailbox[toRook] = Piece::NOTHING;
+  board.mailbox[fromRook] = Piece::ROOK;
 }
 
 #ifndef NDEBUG
@@ -221,6 +242,10 @@ void undoMove(ChessBoard &board, const UndoCTX &ctx) {
 
   color[final] &= ~(1ULL << ctx.move.to);
   color[ctx.move.original] |= 1ULL << ctx.move.from;
+  (board.whiteToMove ? board.whiteFlat : board.blackFlat) ^=
+      (1ULL << ctx.move.from) | (1ULL << ctx.move.to);
+  board.mailbox[ctx.move.to] = Piece::NOTHING;
+  board.mailbox[ctx.move.from] = ctx.move.original;
 
   const bool isCastling =
       ctx.move.original == KING && std::abs(ctx.move.to - ctx.move.from) == 2;
@@ -232,5 +257,11 @@ void undoMove(ChessBoard &board, const UndoCTX &ctx) {
     std::array<std::uint64_t, Piece::KING + 1> &enemyColor =
         board.whiteToMove ? board.blacks : board.whites;
     enemyColor[ctx.move.captured] |= 1ULL << ctx.move.capturedSquare;
+    (board.whiteToMove ? board.blackFlat : board.whiteFlat) |=
+        1ULL << ctx.move.capturedSquare;
+    board.mailbox[ctx.move.capturedSquare] = ctx.move.captured;
   }
+
+  board.occupied = board.whiteFlat | board.blackFlat;
+  assert(board.isOccupancyInSync());
 }
@@ -257,86 +257,132 @@ static auto squaresInBetween(std::uint32_t squareA, std::uint32_t squareB)
   return gain[0];
 }
 
-void MoveGenerator::sort(const MoveCTX *entryBestMove, const std::uint8_t ply,
-                         const bool forWhites) {
-  if (pseudoLegal.empty()) {
-    generatePseudoLegal(false, forWhites);
+auto MovePicker::quietScore(const MoveCTX &move) const -> std::int32_t {
+  // Above any history value, which is above any PSQT value
+  static constexpr std::int32_t PROMOTION_SCORE = 1 << 20;
+  static constexpr std::int32_t HISTORY_SCORE = 1 << 16;
+
+  if (move.promotion != Piece::NOTHING) {
+    return PROMOTION_SCORE + PIECE_VALUES[move.promotion];
   }
 
-  const std::uint64_t whitesFlat = forWhites ? friendlyFlat : enemyFlat;
-  const std::uint64_t blacksFlat = forWhites ? enemyFlat : friendlyFlat;
-  const std::uint64_t enemyKing =
-      forWhites ? board.blacks[Piece::KING] : board.whites[Piece::KING];
+  const std::uint16_t historyScore =
+      history[static_cast<std::size_t>(forWhites)][move.from][move.to];
+  if (historyScore != 0) {
+    return HISTORY_SCORE + historyScore;
+  }
 
-  for (const MoveCTX &move : pseudoLegal) {
-    if (entryBestMove != nullptr && move == *entryBestMove) {
-      buckets[BucketEnum::TT].push_back(move);
-      continue;
-    }
+  return PSQT[move.original]
+             [forWhites ? move.to ^ (BOARD_AREA - BOARD_LENGTH) : move.to];
+}
 
-    if ((getKills(move.original, static_cast<std::int8_t>(move.to),
-                  friendlyFlat, forWhites, enemyFlat) &
-         enemyKing) != 0) {
-      buckets[BucketEnum::CHECKS].push_back(move);
-      continue;
+auto MovePicker::next(MoveCTX &outMove) -> bool {
+  const ChessBoard &board = generator.board;
+
+  switch (currentStage) {
+  case MoveStage::TT:
+    currentStage = MoveStage::GENERATE_CAPTURES;
+    generator.analyzeKing(forWhites);
+    if (entryBestMove != 0 &&
+        generator.unpack(entryBestMove, forWhites, outMove) &&
+        (!onlyCaptures || outMove.captured != Piece::NOTHING) &&
+        generator.isLegal(outMove)) {
+      handedOut[0] = entryBestMove;
+      pickedStage = MoveStage::TT;
+      return true;
     }
+    [[fallthrough]];
+
+  case MoveStage::GENERATE_CAPTURES:
+    generator.moves.clear();
+    generator.generateLegal(GenerationType::KILLS, forWhites);
+    std::ranges::sort(generator.moves,
+                      [](const MoveCTX &first, const MoveCTX &second) {
+                        return MVV_LVA[first.original][first.captured] >
+                               MVV_LVA[second.original][second.captured];
+                      });
+    index = 0;
+    currentStage = MoveStage::GOOD_CAPTURES;
+    [[fallthrough]];
+
+  case MoveStage::GOOD_CAPTURES:
+    while (index < generator.moves.size()) {
+      const MoveCTX &move = generator.moves[index++];
+      if (wasHandedOut(move)) {
+        continue;
+      }
 
-    if (move.captured != Piece::NOTHING) {
-      const std::int32_t seeScore = move.see(whitesFlat, board, blacksFlat);
-
-      if (seeScore >= 0) {
-        buckets[BucketEnum::GOOD_CAPTURES].push_back(move);
-      } else {
-        buckets[BucketEnum::BAD_CAPTURES].push_back(move);
+      // SEE only runs on the captures actually reached
+      if (move.see(board.getFlat(true), board, board.getFlat(false)) < 0) {
+        badCaptures.push_back(move);
+        continue;
       }
 
-      continue;
+      outMove = move;
+      pickedStage = MoveStage::GOOD_CAPTURES;
+      return true;
     }
 
-    if (killers != nullptr &&
-        ((*killers)[ply][0] == move || (*killers)[ply][1] == move)) {
-      buckets[BucketEnum::KILLERS].push_back(move);
-      continue;
+    if (onlyCaptures) {
+      currentStage = MoveStage::DONE;
+      return false;
     }
+    index = 0;
+    currentStage = MoveStage::KILLERS;
+    [[fallthrough]];
+
+  case MoveStage::KILLERS:
+    while (index < killers[ply].size()) {
+      const MoveCTX &killer = killers[ply][index++];
+      if (killer == MoveCTX() || wasHandedOut(killer) ||
+          !generator.unpack(killer.pack(), forWhites, outMove) ||
+          outMove != killer || !generator.isLegal(outMove)) {
+        continue;
+      }
 
-    if (move.promotion != Piece::NOTHING) {
-      buckets[BucketEnum::PROMOTIONS].push_back(move);
-      continue;
+      handedOut[index] = killer.pack();
+      pickedStage = MoveStage::KILLERS;
+      return true;
     }
-
-    if (history != nullptr &&
-        (*history)[static_cast<std::size_t>(forWhites)][move.from][move.to] !=
-            0) {
-      buckets[BucketEnum::HISTORY_HEURISTICS].push_back(move);
-      continue;
+    currentStage = MoveStage::GENERATE_QUIETS;
+    [[fallthrough]];
+
+  case MoveStage::GENERATE_QUIETS:
+    generator.moves.clear();
+    generator.generateLegal(GenerationType::QUIETS, forWhites);
+    std::ranges::sort(generator.moves,
+                      [this](const MoveCTX &first, const MoveCTX &second) {
+                        return quietScore(first) > quietScore(second);
+                      });
+    index = 0;
+    currentStage = MoveStage::QUIETS;
+    [[fallthrough]];
+
+  case MoveStage::QUIETS:
+    while (index < generator.moves.size()) {
+      const MoveCTX &move = generator.moves[index++];
+      if (!wasHandedOut(move)) {
+        outMove = move;
+        pickedStage = MoveStage::QUIETS;
+        return true;
+      }
+    }
+    index = 0;
+    currentStage = MoveStage::BAD_CAPTURES;
+    [[fallthrough]];
+
+  case MoveStage::BAD_CAPTURES:
+    if (index < badCaptures.size()) {
+      outMove = badCaptures[index++];
+      pickedStage = MoveStage::BAD_CAPTURES;
+      return true;
     }
+    currentStage = MoveStage::DONE;
+    [[fallthrough]];
 
-    buckets[BucketEnum::QUIET].push_back(move);
+  case MoveStage::DONE:
+    return false;
   }
 
-  auto compareCaptures = [](const MoveCTX &first, const MoveCTX &second) {
-    return MVV_LVA[first.original][first.captured] >
-           MVV_LVA[second.original][second.captured];
-  };
-
-  std::ranges::sort(buckets[BucketEnum::GOOD_CAPTURES], compareCaptures);
-  std::ranges::sort(buckets[BucketEnum::BAD_CAPTURES], compareCaptures);
-  std::ranges::sort(
-      buckets[BucketEnum::HISTORY_HEURISTICS],
-      [forWhites, this](const MoveCTX &first, const MoveCTX &second) {
-        return (*history)[forWhites][first.from][first.to] >
-               (*history)[forWhites][second.from][second.to];
-      });
-  std::ranges::sort(buckets[BucketEnum::QUIET], [&](const MoveCTX &first,
-                                                    const MoveCTX &second) {
-    return PSQT[first.promotion != Piece::NOTHING ? first.promotion
-                                                  : first.original]
-               [forWhites ? first.to ^ (BOARD_AREA - BOARD_LENGTH) : first.to] >
-           PSQT[second.promotion != Piece::NOTHING ? second.promotion
-                                                   : second.original]
-               [forWhites ? second.to ^ (BOARD_AREA - BOARD_LENGTH)
-                          : second.to];
-  });
-
-  pseudoLegal.clear();
+  return false;
 }
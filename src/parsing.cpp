@@ -127,26 +127,14 @@ ChessBoard::ChessBoard(const std::string &fen) {
   next = fen.find(' ', pos);
   halfmoveClock = std::stoi(fen.substr(pos, next - pos));
 
+  updateOccupancy();
   zobrist = calculateZobrist();
 }
 
 static auto getPieceAt(const std::uint32_t square, const ChessBoard &board)
     -> std::pair<Piece, bool> {
-  const std::uint64_t bit = 1ULL << square;
-
-  for (std::uint32_t type = Piece::PAWN; type <= Piece::KING; type++) {
-    if ((board.whites[type] & bit) != 0) {
-      return std::make_pair(static_cast<Piece>(type), true);
-    }
-  }
-
-  for (std::uint32_t type = Piece::PAWN; type <= Piece::KING; type++) {
-    if ((board.blacks[type] & bit) != 0) {
-      return std::make_pair(static_cast<Piece>(type), false);
-    }
-  }
-
-  return std::make_pair(Piece::NOTHING, false);
+  return std::make_pair(board.mailbox[square],
+                        (board.whiteFlat & (1ULL << square)) != 0);
 }
 
 auto fromAlgebraic(const std::string_view &algebraic, const ChessBoard &board)
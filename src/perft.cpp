@@ -2,38 +2,263 @@
 #include "board.h"
 #include "legalMoves.h"
 #include "move.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <iomanip>
 #include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
-auto perft(const std::uint8_t depth, ChessBoard &board, const bool printMoves)
-    -> std::uint64_t {
+static constexpr std::size_t MB_TO_BYTE_SCALE_FACTOR = 1048576;
+
+PerftTable::PerftTable(const std::size_t megabytes) {
+  const std::size_t count = std::bit_floor(std::max<std::size_t>(
+      megabytes * MB_TO_BYTE_SCALE_FACTOR / sizeof(Entry), 1));
+  entries.assign(count, Entry{0, 0});
+  indexMask = count - 1;
+}
+
+auto PerftTable::index(const std::uint64_t zobrist,
+                       const std::uint8_t depth) const -> std::size_t {
+  // Spread the depths of one position over different slots
+  return (zobrist ^ (depth * 0x9E3779B97F4A7C15ULL)) & indexMask;
+}
+
+auto PerftTable::probe(const std::uint64_t zobrist, const std::uint8_t depth,
+                       std::uint64_t &outNodes) -> bool {
+  Entry &entry = entries[index(zobrist, depth)];
+  const std::uint64_t data =
+      std::atomic_ref(entry.data).load(std::memory_order_relaxed);
+  const std::uint64_t key =
+      std::atomic_ref(entry.key).load(std::memory_order_relaxed);
+  if ((key ^ data) != zobrist || (data & 0xFF) != depth) {
+    return false;
+  }
+
+  outNodes = data >> 8;
+  return true;
+}
+
+void PerftTable::store(const std::uint64_t zobrist, const std::uint8_t depth,
+                       const std::uint64_t nodes) {
+  Entry &entry = entries[index(zobrist, depth)];
+  const std::uint64_t data = nodes << 8 | depth;
+  std::atomic_ref(entry.data).store(data, std::memory_order_relaxed);
+  std::atomic_ref(entry.key).store(zobrist ^ data, std::memory_order_relaxed);
+}
+
+auto perft(const std::uint8_t depth, ChessBoard &board, const bool printMoves,
+           PerftTable *table) -> std::uint64_t {
   if (depth == 0) {
     return 1ULL;
   }
 
-  std::uint64_t nodes = 0;
-
   const bool forWhites = board.whiteToMove;
 
   MoveGenerator generator(board);
-  generator.generatePseudoLegal(false, forWhites);
-  generator.appendCastling(board, forWhites);
+  generator.generateLegal(GenerationType::ALL, forWhites);
+
+  // Every generated move is legal, so the last ply is just the list size
+  if (depth == 1 && !printMoves) {
+    return generator.moves.size();
+  }
+
+  std::uint64_t nodes = 0;
+
+  // Divide has to print every root move, so the root is never looked up
+  if (table != nullptr && !printMoves &&
+      table->probe(board.zobrist, depth, nodes)) {
+    return nodes;
+  }
 
-  for (const auto &move : generator.pseudoLegal) {
+  for (const auto &move : generator.moves) {
     const UndoCTX undo(move, board);
 
     makeMove(board, move);
 
-    if (!board.isKingInCheck(forWhites)) {
-      const std::uint64_t leafNodes = perft(depth - 1, board, false);
-      if (printMoves) {
-        std::cout << moveToUCI(move) << ": " << leafNodes << '\n';
-      }
-      nodes += leafNodes;
+    const std::uint64_t leafNodes = perft(depth - 1, board, false, table);
+    if (printMoves) {
+      std::cout << moveToUCI(move) << ": " << leafNodes << '\n';
     }
+    nodes += leafNodes;
 
     undoMove(board, undo);
   }
 
+  if (table != nullptr) {
+    table->store(board.zobrist, depth, nodes);
+  }
+
   return nodes;
 }
+
+auto parallelPerft(const std::uint8_t depth, const ChessBoard &board,
+                   const bool printMoves, const std::uint32_t threads,
+                   PerftTable *table) -> std::uint64_t {
+  ChessBoard rootBoard = board;
+  if (threads <= 1 || depth < 3) {
+    return perft(depth, rootBoard, printMoves, table);
+  }
+
+  // Root moves alone are too few and too uneven to keep every thread busy, so
+  // the work items are the ply 2 moves
+  struct Split {
+    std::size_t root;
+    MoveCTX reply;
+  };
+
+  MoveGenerator rootGenerator(rootBoard);
+  rootGenerator.generateLegal(GenerationType::ALL, rootBoard.whiteToMove);
+
+  std::vector<Split> splits;
+  for (std::size_t i = 0; i < rootGenerator.moves.size(); i++) {
+    const MoveCTX &move = rootGenerator.moves[i];
+    const UndoCTX undo(move, rootBoard);
+    makeMove(rootBoard, move);
+
+    MoveGenerator generator(rootBoard);
+    generator.generateLegal(GenerationType::ALL, rootBoard.whiteToMove);
+    for (const auto &reply : generator.moves) {
+      splits.push_back(Split{i, reply});
+    }
+
+    undoMove(rootBoard, undo);
+  }
+
+  std::vector<std::uint64_t> splitNodes(splits.size(), 0);
+  std::atomic<std::size_t> nextSplit = 0;
+
+  auto work = [&] {
+    ChessBoard workerBoard = board;
+    for (std::size_t i = nextSplit.fetch_add(1, std::memory_order_relaxed);
+         i < splits.size();
+         i = nextSplit.fetch_add(1, std::memory_order_relaxed)) {
+      const MoveCTX &move = rootGenerator.moves[splits[i].root];
+      const UndoCTX undo(move, workerBoard);
+      makeMove(workerBoard, move);
+      const UndoCTX replyUndo(splits[i].reply, workerBoard);
+      makeMove(workerBoard, splits[i].reply);
+
+      splitNodes[i] = perft(depth - 2, workerBoard, false, table);
+
+      undoMove(workerBoard, replyUndo);
+      undoMove(workerBoard, undo);
+    }
+  };
+
+  {
+    const std::size_t workerCount =
+        std::min<std::size_t>(threads, splits.size());
+    std::vector<std::jthread> workers;
+    workers.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; i++) {
+      workers.emplace_back(work);
+    }
+  }
+
+  std::vector<std::uint64_t> rootNodes(rootGenerator.moves.size(), 0);
+  for (std::size_t i = 0; i < splits.size(); i++) {
+    rootNodes[splits[i].root] += splitNodes[i];
+  }
+
+  std::uint64_t nodes = 0;
+  for (std::size_t i = 0; i < rootNodes.size(); i++) {
+    if (printMoves) {
+      std::cout << moveToUCI(rootGenerator.moves[i]) << ": " << rootNodes[i]
+                << '\n';
+    }
+    nodes += rootNodes[i];
+  }
+
+  return nodes;
+}
+
+struct PerftPosition {
+  std::string_view name;
+  std::string_view fen;
+  // Reference counts for depth 1 and up, zero past the deepest known one
+  std::array<std::uint64_t, 7> nodes;
+};
+
+// Chess Programming Wiki perft results page
+static constexpr std::array<PerftPosition, 6> PERFT_SUITE{{
+    {"startpos",
+     "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+     {20, 400, 8902, 197281, 4865609, 119060324, 0}},
+    {"kiwipete",
+     "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+     {48, 2039, 97862, 4085603, 193690690, 0, 0}},
+    {"position3",
+     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+     {14, 191, 2812, 43238, 674624, 11030083, 178633661}},
+    {"position4",
+     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+     {6, 264, 9467, 422333, 15833292, 0, 0}},
+    {"position5",
+     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+     {44, 1486, 62379, 2103487, 89941194, 0, 0}},
+    {"position6",
+     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 "
+     "10",
+     {46, 2079, 89890, 3894594, 164075551, 0, 0}},
+}};
+
+static void printSpeed(const std::uint64_t nodes, const std::int64_t ms) {
+  const double mnps = static_cast<double>(nodes) /
+                      static_cast<double>(std::max<std::int64_t>(ms, 1)) /
+                      1000.0;
+  std::cout << ms << " ms " << std::fixed << std::setprecision(2) << mnps
+            << " Mnps" << std::defaultfloat << '\n';
+}
+
+auto perftSuite(const std::uint8_t maxDepth, const std::uint32_t threads,
+                PerftTable *table) -> bool {
+  std::uint64_t totalNodes = 0;
+  std::int64_t totalMs = 0;
+  std::uint32_t failed = 0;
+
+  for (const PerftPosition &position : PERFT_SUITE) {
+    std::uint8_t depth = 0;
+    while (depth < position.nodes.size() && position.nodes[depth] != 0 &&
+           (maxDepth == 0 || depth < maxDepth)) {
+      depth++;
+    }
+
+    const ChessBoard board{std::string(position.fen)};
+
+    const auto start = std::chrono::steady_clock::now();
+    const std::uint64_t nodes =
+        parallelPerft(depth, board, false, threads, table);
+    const std::int64_t ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count();
+
+    const std::uint64_t expected = position.nodes[depth - 1];
+    failed += nodes != expected ? 1 : 0;
+    totalNodes += nodes;
+    totalMs += ms;
+
+    std::cout << "info string perftsuite " << position.name << " depth "
+              << static_cast<std::uint32_t>(depth) << " nodes " << nodes;
+    if (nodes == expected) {
+      std::cout << " ok ";
+    } else {
+      std::cout << " FAILED expected " << expected << ' ';
+    }
+    printSpeed(nodes, ms);
+  }
+
+  std::cout << "info string perftsuite total nodes " << totalNodes << ' '
+            << (failed == 0 ? "ok" : "FAILED") << ' ';
+  printSpeed(totalNodes, totalMs);
+
+  return failed == 0;
+}
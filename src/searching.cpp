@@ -9,6 +9,8 @@
 #include <cstdint>
 #include <iostream>
 #include <ostream>
+#include <sstream>
+#include <thread>
 
 static constexpr std::uint8_t REDUCTION_MAX_MOVE_INDEX = 218;
 static const std::array<std::array<std::uint8_t, REDUCTION_MAX_MOVE_INDEX>,
@@ -32,7 +34,7 @@ static const std::array<std::array<std::uint8_t, REDUCTION_MAX_MOVE_INDEX>,
 
 struct EntryStoringCTX {
   std::uint8_t ply, depth;
-  std::int32_t bestScore, alphaOriginal, beta;
+  std::int32_t bestScore, alphaOriginal, beta, staticEval;
 };
 
 struct EntryProbingCTX {
@@ -40,20 +42,68 @@ struct EntryProbingCTX {
   std::int32_t &alpha, &beta;
 };
 
+// Monotonic, a wall clock adjustment mid search must not end it or extend it
 static auto nowMs() -> std::uint64_t {
   return std::chrono::duration_cast<std::chrono::milliseconds>(
-             std::chrono::system_clock::now().time_since_epoch())
+             std::chrono::steady_clock::now().time_since_epoch())
       .count();
 }
 
-static auto probeTTEntry(const TTEntry *entry, EntryProbingCTX &ctx,
-                         std::int32_t &outScore, const ChessBoard &board)
-    -> bool {
-  if (entry->key != board.zobrist || entry->depth < ctx.depth) {
+void Searching::checkTime() {
+  // Helpers never have a limit, so they skip the clock entirely
+  if (!timeManager.isLimited() || pondering.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  const std::uint64_t elapsed =
+      nowMs() - clockStart.load(std::memory_order_relaxed);
+  if (elapsed >= timeManager.hardLimit()) {
+    stop.store(true, std::memory_order_relaxed);
+  }
+}
+
+void Searching::ponderhit() {
+  clockStart.store(nowMs(), std::memory_order_relaxed);
+  endPondering();
+}
+
+void Searching::setThreads(const std::uint32_t threads) {
+  helpers.clear();
+  helperBoards.clear();
+
+  for (std::uint32_t i = 1; i < threads; i++) {
+    helperBoards.push_back(std::make_unique<ChessBoard>(board));
+    helpers.push_back(
+        std::make_unique<Searching>(*helperBoards.back(), TT, stop));
+  }
+}
+
+void Searching::setMultiPV(const std::uint32_t count) {
+  multiPV = std::clamp<std::uint32_t>(count, 1, MAX_MOVES_IN_A_POSITION);
+  lines.assign(multiPV, RootLine{});
+  nextLines.assign(multiPV, RootLine{});
+  lineCount = 0;
+}
+
+void Searching::helperSearch(const std::uint8_t maxDepth,
+                             const std::size_t helperIndex) {
+  // Odd helpers start one ply deeper so the threads don't walk the same tree
+  // in lockstep, the shared TT does the rest
+  lineCount = 0;
+  for (std::uint8_t depth = 1 + (helperIndex & 1);
+       depth <= maxDepth && !shouldStop(); depth++) {
+    seldepth = 0;
+    static_cast<void>(search(depth));
+  }
+}
+
+static auto probeTTEntry(const TTEntry &entry, EntryProbingCTX &ctx,
+                         std::int32_t &outScore) -> bool {
+  if (entry.depth < ctx.depth) {
     return false;
   }
 
-  std::int32_t entryScore = entry->score;
+  std::int32_t entryScore = entry.score;
 
 #ifndef NDEBUG
   assert(std::abs(entryScore) <= CHECKMATE_SCORE + MAX_SEARCHING_DEPTH &&
@@ -66,14 +116,14 @@ static auto probeTTEntry(const TTEntry *entry, EntryProbingCTX &ctx,
     entryScore += ctx.ply;
   }
 
-  if (entry->flag == TTEntry::EXACT) {
+  if (entry.flag == TTEntry::EXACT) {
     outScore = entryScore;
     return true; // Direct hit
   }
 
-  if (entry->flag == TTEntry::LOWERBOUND && entryScore > ctx.alpha) {
+  if (entry.flag == TTEntry::LOWERBOUND && entryScore > ctx.alpha) {
     ctx.alpha = entryScore;
-  } else if (entry->flag == TTEntry::UPPERBOUND && entryScore < ctx.beta) {
+  } else if (entry.flag == TTEntry::UPPERBOUND && entryScore < ctx.beta) {
     ctx.beta = entryScore;
   }
 
@@ -92,10 +142,9 @@ static void storeEntry(const ChessBoard &board, TranspositionTable &table,
   }
 
   TTEntry newEntry;
-  newEntry.key = board.zobrist;
-  newEntry.bestMove = bestMove;
+  newEntry.bestMove = bestMove.pack();
   newEntry.depth = ctx.depth;
-  newEntry.score = ctx.bestScore;
+  newEntry.staticEval = static_cast<std::int16_t>(ctx.staticEval);
 
   if (ctx.bestScore <= ctx.alphaOriginal) {
     newEntry.flag = TTEntry::UPPERBOUND;
@@ -105,23 +154,45 @@ static void storeEntry(const ChessBoard &board, TranspositionTable &table,
     newEntry.flag = TTEntry::EXACT;
   }
 
-  if (newEntry.score > CHECKMATE_THRESHOLD) {
-    newEntry.score += ctx.ply;
-  } else if (newEntry.score < -CHECKMATE_THRESHOLD) {
-    newEntry.score -= ctx.ply;
+  std::int32_t score = ctx.bestScore;
+  if (score > CHECKMATE_THRESHOLD) {
+    score += ctx.ply;
+  } else if (score < -CHECKMATE_THRESHOLD) {
+    score -= ctx.ply;
   }
+  newEntry.score = static_cast<std::int16_t>(score);
 
-  table.store(newEntry);
+  table.store(board.zobrist, newEntry);
 }
 
-auto Searching::iterativeDeepening(const std::uint64_t timeLimitMs) -> MoveCTX {
+auto Searching::iterativeDeepening(const TimeManager &time,
+                                   std::uint8_t maxDepth) -> MoveCTX {
   startingTime = nowMs();
-  endTime = timeLimitMs + startingTime;
+  clockStart.store(startingTime, std::memory_order_relaxed);
+  timeManager = time;
+  maxDepth = std::min<std::uint8_t>(maxDepth, MAX_SEARCHING_DEPTH - 1);
 
   MoveCTX bestMove;
+  lineCount = 0;
 
-  for (std::uint8_t depth = 1; depth < MAX_SEARCHING_DEPTH; depth++) {
-    if (nowMs() >= endTime) {
+  TT.newSearch();
+
+  std::vector<std::jthread> workers;
+  workers.reserve(helpers.size());
+  for (std::size_t i = 0; i < helpers.size(); i++) {
+    Searching &helper = *helpers[i];
+    helper.board = board;
+    helper.keyStack = keyStack;
+    helper.keyCount = keyCount;
+    helper.startingTime = startingTime;
+
+    workers.emplace_back(
+        [&helper, maxDepth, i] { helper.helperSearch(maxDepth, i); });
+  }
+
+  for (std::uint8_t depth = 1; depth <= maxDepth; depth++) {
+    checkTime();
+    if (shouldStop()) {
       break;
     }
 
@@ -130,40 +201,67 @@ auto Searching::iterativeDeepening(const std::uint64_t timeLimitMs) -> MoveCTX {
     // The search function assigns the best move
     const auto [PVMove, bestScore] = search(depth);
 
-    if (nowMs() < endTime) {
+    if (!shouldStop()) {
       bestMove = PVMove;
 
+      const std::uint64_t searchedNodes = totalNodes();
       const double elapsedTimeSeconds =
           static_cast<double>(nowMs() - startingTime) / 1000;
-      const double nps = static_cast<double>(nodes) / elapsedTimeSeconds;
-
-      constexpr std::uint16_t SAMPLED_ENTRIES = 1000;
-      std::uint16_t count = 0;
-      for (std::uint64_t i = 0; i < SAMPLED_ENTRIES; i++) {
-        std::size_t idx = (i * TranspositionTable::size()) / SAMPLED_ENTRIES;
-        if (TT.table[idx].key != UINT64_MAX) {
-          count++;
+      const double nps =
+          static_cast<double>(searchedNodes) / elapsedTimeSeconds;
+
+      // One write, the input thread may be printing at the same time
+      std::ostringstream info;
+      for (std::size_t i = 0; i < lineCount; i++) {
+        info << "info depth " << static_cast<std::uint64_t>(depth)
+             << " seldepth " << seldepth;
+        if (multiPV > 1) {
+          info << " multipv " << i + 1;
+        }
+        info << " score cp " << lines[i].score << " nodes " << searchedNodes
+             << " nps " << static_cast<std::uint64_t>(nps) << " hashfull "
+             << TT.hashfull() << " pv";
+        for (std::uint8_t j = 0; j < lines[i].length; j++) {
+          info << ' ' << moveToUCI(lines[i].moves[j]);
         }
+        info << '\n';
+      }
+      std::cout << info.str() << std::flush;
+
+      timeManager.update(bestMove, bestScore);
+      const bool outOfSoftTime =
+          !pondering.load(std::memory_order_acquire) &&
+          !timeManager.shouldStartIteration(
+              nowMs() - clockStart.load(std::memory_order_relaxed));
+      if (outOfSoftTime) {
+        break;
       }
-
-      static constexpr std::uint32_t HASHFULL_SCALE = 1000;
-
-      std::cout << "info depth " << static_cast<std::uint64_t>(depth)
-                << " seldepth " << seldepth << " score cp " << bestScore
-                << " nodes " << nodes << " nps "
-                << static_cast<std::uint64_t>(nps) << " hashfull "
-                << static_cast<std::uint64_t>(count * HASHFULL_SCALE) /
-                       SAMPLED_ENTRIES
-                << " pv " << moveToUCI(bestMove) << '\n';
-      std::flush(std::cout);
     } else {
       break;
     }
   }
 
+  // UCI wants the best move held back until the ponder or infinite search is
+  // ended from outside, even when it ran out of depth
+  while (pondering.load(std::memory_order_relaxed)) {
+    pondering.wait(true, std::memory_order_relaxed);
+  }
+
+  stop.store(true, std::memory_order_relaxed);
+  workers.clear(); // Joins the helpers
+
+  // Stopped before depth 1 was done, any legal move beats a null one
+  if (bestMove == MoveCTX{}) {
+    MoveGenerator generator(board);
+    generator.generateLegal(GenerationType::ALL, board.whiteToMove);
+    if (!generator.moves.empty()) {
+      bestMove = generator.moves[0];
+    }
+  }
+
   afterSearch();
 
-  endTime = UINT64_MAX;
+  timeManager = TimeManager();
   startingTime = 0;
 
   return bestMove;
@@ -173,7 +271,6 @@ auto Searching::search(const std::uint8_t depth)
     -> std::pair<MoveCTX, std::int32_t> {
   MoveCTX bestMove;
   std::int32_t bestScore = -INF;
-  const bool forWhites = board.whiteToMove;
 
   static constexpr std::uint8_t BASE_DELTA = 50;
   std::uint8_t delta = BASE_DELTA;
@@ -190,77 +287,152 @@ auto Searching::search(const std::uint8_t depth)
     beta = INF;
   }
 
-  const TTEntry *entry = TT.probe(board.zobrist);
-  const MoveCTX *entryBestMove =
-      entry != nullptr && entry->depth != 0 ? &entry->bestMove : nullptr;
+  TTEntry entry;
+  const bool hasEntry = TT.probe(board.zobrist, entry);
+  const std::uint16_t entryBestMove =
+      hasEntry && entry.depth != 0 ? entry.bestMove : 0;
 
-  if (entry != nullptr && entry->depth >= depth - 2) {
-    lastScore = entry->score;
+  if (hasEntry && entry.depth >= depth - 2) {
+    lastScore = entry.score;
   }
 
   bool foundMove = false;
+  std::size_t pvIndex = 0;
 
-  MoveGenerator generator(killers, history, board);
-  generator.generatePseudoLegal(false, forWhites);
-  generator.appendCastling(board, forWhites);
-  generator.sort(entryBestMove, 0, forWhites);
+  // Moves that head an earlier line of this iteration
+  auto isExcluded = [&](const MoveCTX &move) {
+    for (std::size_t i = 0; i < pvIndex; i++) {
+      if (nextLines[i].moves[0] == move) {
+        return true;
+      }
+    }
+    return false;
+  };
 
   auto searchMoves = [&](const std::int32_t currentAlpha,
                          const std::int32_t currentBeta) {
     bestScore = -INF;
-    for (BucketEnum bucket = BucketEnum::TT; bucket <= BucketEnum::QUIET;
-         ++bucket) {
-      for (const MoveCTX &move : generator.buckets[bucket]) {
-        const UndoCTX undo(move, board);
-        makeMove(board, move);
-        appendZobristHistory();
-
-        if (!board.isKingInCheck(forWhites)) {
-          foundMove = true;
-          const std::int32_t score =
-              -negamax<NodeType::PV>(-currentBeta, -currentAlpha, depth - 1, 1);
-
-          if (score > bestScore) {
-            bestScore = score;
-            bestMove = move;
-          }
-        }
-        undoMove(board, undo);
-        popZobristHistory();
+    pvLength[0] = 0;
+    followedLine = pvIndex;
+    followPV = pvIndex < lineCount;
+    const std::uint16_t pvMove = pvMoveAt(0);
+
+    MovePicker picker(board, pvMove != 0 ? pvMove : entryBestMove, killers,
+                      history, 0, false);
+    MoveCTX move;
+    while (picker.next(move)) {
+      if (isExcluded(move)) {
+        continue;
+      }
+
+      const ScopedMove guard(*this, 0, move);
+      followPV = followPV && move.pack() == pvMove;
+
+      foundMove = true;
+      const std::int32_t score =
+          -negamax<NodeType::PV>(-currentBeta, -currentAlpha, depth - 1, 1);
+
+      if (score > bestScore) {
+        bestScore = score;
+        bestMove = move;
+        updatePV(0, move);
       }
     }
   };
 
-  searchMoves(alpha, beta);
+  // One pass per line, each over the root moves the earlier ones left. Only
+  // the first pass has an aspiration window, it's the only one with a score
+  // from the last iteration to center it on
+  for (; pvIndex < multiPV; pvIndex++) {
+    foundMove = false;
+    if (pvIndex == 0) {
+      searchMoves(alpha, beta);
+      if (foundMove && (bestScore <= alpha || bestScore >= beta)) {
+        searchMoves(-INF, INF);
+      }
+    } else {
+      searchMoves(-INF, INF);
+    }
+
+    if (!foundMove || shouldStop()) {
+      break;
+    }
 
-  if (!foundMove) {
-    return {MoveCTX(),
-            board.isKingInCheck(board.whiteToMove) ? -CHECKMATE_SCORE : 0};
+    RootLine &line = nextLines[pvIndex];
+    line.score = bestScore;
+    line.length = pvLength[0];
+    std::copy_n(pvTable[0].begin(), pvLength[0], line.moves.begin());
   }
 
-  if (bestScore <= alpha || bestScore >= beta) {
-    searchMoves(-INF, INF);
+  if (pvIndex == 0) {
+    if (!foundMove) {
+      return {MoveCTX(),
+              board.isKingInCheck(board.whiteToMove) ? -CHECKMATE_SCORE : 0};
+    }
+    return {bestMove, bestScore}; // Stopped in the first pass
+  }
+
+  bestMove = nextLines[0].moves[0];
+  bestScore = nextLines[0].score;
+
+  // An aborted iteration leaves half searched lines behind
+  if (!shouldStop()) {
+    std::swap(lines, nextLines);
+    lineCount = pvIndex;
   }
 
   lastScore = bestScore;
   return {bestMove, bestScore};
 }
 
+void Searching::fillPVFromTT(const std::uint8_t ply, const std::uint8_t depth) {
+  ChessBoard position = boardAt(ply);
+  std::uint8_t end = ply;
+
+  // The hit stands for `depth` plies at most, which also ends any cycle
+  while (end < ply + depth && end < MAX_DEPTH) {
+    TTEntry entry;
+    if (!TT.probe(position.zobrist, entry) || entry.bestMove == 0) {
+      break;
+    }
+
+    MoveGenerator generator(position);
+    generator.generateLegal(GenerationType::ALL, position.whiteToMove);
+    const MoveCTX *move =
+        std::find_if(generator.moves.begin(), generator.moves.end(),
+                     [&](const MoveCTX &legal) {
+                       return legal.pack() == entry.bestMove;
+                     });
+    if (move == generator.moves.end()) {
+      break;
+    }
+
+    pvTable[ply][end++] = *move;
+    makeMove(position, *move);
+  }
+
+  pvLength[ply] = end;
+}
+
 template <NodeType nodeType>
 auto Searching::negamax(std::int32_t alpha, std::int32_t beta,
                         const std::uint8_t depth, const std::uint8_t ply)
     -> std::int32_t {
-  const bool forWhites = board.whiteToMove;
+  const ChessBoard &position = boardAt(ply);
+  const bool forWhites = position.whiteToMove;
   const auto forWhitesInteger = static_cast<const std::uint8_t>(forWhites);
 
+  // Every return before a move raises alpha leaves the line empty
+  pvLength[ply] = ply;
+
   if (depth == 0) {
     return quiescence(alpha, beta, ply);
   }
 
   seldepth = std::max(seldepth, static_cast<std::uint64_t>(ply));
-  nodes++;
+  countNode();
 
-  if (board.isDraw(zobristHistory)) {
+  if (position.isDraw() || isRepetition(position, ply)) {
     return 0;
   }
 
@@ -282,122 +454,131 @@ auto Searching::negamax(std::int32_t alpha, std::int32_t beta,
     }
   }
 
+  TTEntry entry;
+  const bool hasEntry = TT.probe(position.zobrist, entry);
+
   const std::int32_t staticEvaluation =
-      forWhites ? board.evaluate() : -board.evaluate();
+      hasEntry ? entry.staticEval
+               : (forWhites ? position.evaluate() : -position.evaluate());
 
-  static constexpr std::uint32_t TIMEOUT_CHECKING = 1024;
-  if ((nodes & TIMEOUT_CHECKING) == 0 && nowMs() >= endTime) {
+  if (shouldStop()) {
     return staticEvaluation;
   }
 
   const std::int32_t alphaOriginal = alpha;
 
-  const TTEntry *entry = TT.probe(board.zobrist);
-  if (entry != nullptr) {
+  // With several lines every later pass would hit the exact entries of the
+  // earlier ones and cut its line short, so there PV nodes are searched out
+  if (hasEntry && (nodeType == NodeType::NonPV || multiPV == 1)) {
     std::int32_t entryScore;
     EntryProbingCTX ctx = {
         .ply = ply, .depth = depth, .alpha = alpha, .beta = beta};
-    if (probeTTEntry(entry, ctx, entryScore, board)) {
+    if (probeTTEntry(entry, ctx, entryScore)) {
+      if constexpr (nodeType == NodeType::PV) {
+        fillPVFromTT(ply, depth);
+      }
       return entryScore;
     }
   }
 
-  const bool inCheck = board.isKingInCheck(forWhites);
+  const bool inCheck = position.isKingInCheck(forWhites);
   const bool canFutilityPrune =
       depth == 1 && !inCheck && nodeType == NodeType::NonPV;
   constexpr std::int32_t FUTILITY_MARGIN = 200;
 
   std::int32_t bestScore = -INF;
-  const MoveCTX *entryBestMove =
-      entry != nullptr && entry->depth != 0 ? &entry->bestMove : nullptr;
+  const std::uint16_t entryBestMove =
+      hasEntry && entry.depth != 0 ? entry.bestMove : 0;
   MoveCTX bestMove;
 
-  MoveGenerator generator(killers, history, board);
-  generator.generatePseudoLegal(false, forWhites);
-  generator.appendCastling(board, forWhites);
-  generator.sort(entryBestMove, ply, forWhites);
+  const std::uint16_t pvMove = pvMoveAt(ply);
+  MovePicker picker(position, pvMove != 0 ? pvMove : entryBestMove, killers,
+                    history, ply, false);
+  MoveCTX move;
 
   bool hasLegalMoves = false;
   std::uint8_t moveIndex = 0;
-  for (BucketEnum bucket = BucketEnum::TT; bucket <= BucketEnum::QUIET;
-       ++bucket) {
-    for (const MoveCTX &move : generator.buckets[bucket]) {
-      ScopedUndo guard(board, move, *this);
-
-      if (!board.isKingInCheck(forWhites)) {
-        hasLegalMoves = true;
-        moveIndex++;
-
-        const bool isQuiet = bucket == QUIET || bucket == KILLERS ||
-                             bucket == HISTORY_HEURISTICS;
-        if (canFutilityPrune && staticEvaluation + FUTILITY_MARGIN < alpha &&
-            isQuiet) {
-          continue;
-        }
+  while (picker.next(move)) {
+    const MoveStage stage = picker.stage();
+    const ScopedMove guard(*this, ply, move);
+    // Only the first move searched can still be on the previous line
+    followPV = followPV && move.pack() == pvMove;
+    hasLegalMoves = true;
+    moveIndex++;
+
+    // Quiet checks are neither pruned nor reduced
+    const bool isQuiet =
+        (stage == MoveStage::KILLERS || stage == MoveStage::QUIETS) &&
+        move.promotion == Piece::NOTHING &&
+        !guard.position().isKingInCheck(!forWhites);
+    if (canFutilityPrune && staticEvaluation + FUTILITY_MARGIN < alpha &&
+        isQuiet) {
+      continue;
+    }
 
-        std::int32_t score;
-
-        constexpr std::uint16_t HISTORY_GOOD = 1000;
-        const bool isGoodMove =
-            history[forWhitesInteger][move.from][move.to] > HISTORY_GOOD;
-
-        const bool noReduce = bucket == BucketEnum::TT || bucket == CHECKS ||
-                              bucket == GOOD_CAPTURES || bucket == PROMOTIONS ||
-                              inCheck || moveIndex == 0 || isGoodMove ||
-                              depth < 2;
-        if (noReduce) {
-          score = -negamax<nodeType>(-beta, -alpha, depth - 1, ply + 1);
-        } else {
-          score = -negamax<NodeType::NonPV>(
-              -alpha - 1, -alpha,
-              std::max(1, depth - REDUCTION_TABLE[depth][moveIndex]), ply + 1);
-          if (score > alpha && score < beta) {
-            score = -negamax<NodeType::PV>(-beta, -alpha, depth - 1, ply + 1);
-          }
-        }
+    std::int32_t score;
 
-        if (score > bestScore) {
-          bestScore = score;
-          bestMove = move;
-        }
-        alpha = std::max(score, alpha);
+    constexpr std::uint16_t HISTORY_GOOD = 1000;
+    const bool isGoodMove =
+        history[forWhitesInteger][move.from][move.to] > HISTORY_GOOD;
 
-        if ((nodes & TIMEOUT_CHECKING) == 0 && nowMs() >= endTime) {
-          return 0;
-        }
+    const bool noReduce = (!isQuiet && stage != MoveStage::BAD_CAPTURES) ||
+                          inCheck || moveIndex == 0 || isGoodMove || depth < 2;
+    if (noReduce) {
+      score = -negamax<nodeType>(-beta, -alpha, depth - 1, ply + 1);
+    } else {
+      score = -negamax<NodeType::NonPV>(
+          -alpha - 1, -alpha,
+          std::max(1, depth - REDUCTION_TABLE[depth][moveIndex]), ply + 1);
+      if (score > alpha && score < beta) {
+        score = -negamax<NodeType::PV>(-beta, -alpha, depth - 1, ply + 1);
+      }
+    }
+
+    if (score > bestScore) {
+      bestScore = score;
+      bestMove = move;
+    }
+    if constexpr (nodeType == NodeType::PV) {
+      if (score > alpha) {
+        updatePV(ply, move);
+      }
+    }
+    alpha = std::max(score, alpha);
 
-        if (alpha >= beta) {
-          if (move.captured == Piece::NOTHING) {
-            // Store killer moves
-            if (killers[ply][0] != move) {
-              killers[ply][1] = killers[ply][0];
-              killers[ply][0] = move;
-            }
-
-            std::uint16_t &entry =
-                history[forWhitesInteger][move.from][move.to];
-            const std::uint16_t bonus = depth * depth;
-            entry = (entry > UINT16_MAX - bonus) ? UINT16_MAX : entry + bonus;
-          }
-
-          goto searchEnd;
+    if (shouldStop()) {
+      return 0;
+    }
+
+    if (alpha >= beta) {
+      if (move.captured == Piece::NOTHING) {
+        // Store killer moves
+        if (killers[ply][0] != move) {
+          killers[ply][1] = killers[ply][0];
+          killers[ply][0] = move;
         }
+
+        std::uint16_t &entry = history[forWhitesInteger][move.from][move.to];
+        const std::uint16_t bonus = depth * depth;
+        entry = (entry > UINT16_MAX - bonus) ? UINT16_MAX : entry + bonus;
       }
+
+      break;
     }
   }
 
-searchEnd:
   if (!hasLegalMoves) {
     // If king is in check it's checkmate, if no it's stalemate
     return inCheck ? -mateScore : 0;
   }
 
-  storeEntry(board, TT, bestMove,
+  storeEntry(position, TT, bestMove,
              {.ply = ply,
               .depth = depth,
               .bestScore = bestScore,
               .alphaOriginal = alphaOriginal,
-              .beta = beta});
+              .beta = beta,
+              .staticEval = staticEvaluation});
 
   return bestScore;
 }
@@ -414,78 +595,69 @@ Searching::negamax<NodeType::PV>(std::int32_t alpha, std::int32_t beta,
 [[nodiscard]] auto Searching::quiescence(std::int32_t alpha, std::int32_t beta,
                                         const std::uint8_t ply)
     -> std::int32_t {
-  const bool forWhites = board.whiteToMove;
+  const ChessBoard &position = boardAt(ply);
+  const bool forWhites = position.whiteToMove;
   const std::int32_t alphaOriginal = alpha;
 
-  nodes++;
+  countNode();
   seldepth = std::max(seldepth, static_cast<std::uint64_t>(ply));
 
+  TTEntry entry;
+  const bool hasEntry = TT.probe(position.zobrist, entry);
+
   const std::int32_t staticEvaluation =
-      forWhites ? board.evaluate() : -board.evaluate();
+      hasEntry ? entry.staticEval
+               : (forWhites ? position.evaluate() : -position.evaluate());
   std::int32_t bestValue = staticEvaluation;
   if (bestValue >= beta) {
     return bestValue;
   }
   alpha = std::max(bestValue, alpha);
 
-  if (nowMs() >= endTime) {
+  if (shouldStop()) {
     return bestValue;
   }
 
-  const bool inCheck = board.isKingInCheck(forWhites);
-
-  const TTEntry *entry = TT.probe(board.zobrist);
-
-  // This generates only pseudo-legal kills if king isn't in check, generate all
-  // of them if it is though, that's why `!inCheck` is there
-  MoveGenerator generator(killers, history, board);
-  generator.generatePseudoLegal(!inCheck, forWhites);
-  generator.sort(entry != nullptr ? &entry->bestMove : nullptr, ply, forWhites);
-
-  for (BucketEnum bucket = BucketEnum::TT; bucket <= BucketEnum::QUIET;
-       ++bucket) {
-    if (!inCheck && bucket != GOOD_CAPTURES) {
-      continue;
+  const bool inCheck = position.isKingInCheck(forWhites);
+
+  // Only captures if king isn't in check, every move if it is though, that's
+  // why `!inCheck` is there
+  MovePicker picker(position, hasEntry ? entry.bestMove : 0, killers, history,
+                    ply, !inCheck);
+  MoveCTX move;
+  while (picker.next(move)) {
+    std::int32_t score;
+    {
+      const ScopedMove guard(*this, ply, move);
+      score = -quiescence(-beta, -alpha, ply + 1);
     }
 
-    for (const MoveCTX &move : generator.buckets[bucket]) {
-      const UndoCTX undo(move, board);
-      makeMove(board, move);
-      appendZobristHistory();
-
-      std::int32_t score = -INF;
-      if (!board.isKingInCheck(forWhites)) {
-        score = -quiescence(-beta, -alpha, ply + 1);
-      }
-
-      undoMove(board, undo);
-      popZobristHistory();
-
-      if (score >= beta) {
-        storeEntry(board, TT, move,
-                   {.ply = ply,
-                    .depth = 0,
-                    .bestScore = score,
-                    .alphaOriginal = alphaOriginal,
-                    .beta = beta});
-        return score;
-      }
+    if (score >= beta) {
+      storeEntry(position, TT, move,
+                 {.ply = ply,
+                  .depth = 0,
+                  .bestScore = score,
+                  .alphaOriginal = alphaOriginal,
+                  .beta = beta,
+                  .staticEval = staticEvaluation});
+      return score;
+    }
 
-      bestValue = std::max(score, bestValue);
-      alpha = std::max(score, alpha);
+    bestValue = std::max(score, bestValue);
+    alpha = std::max(score, alpha);
 
-      if (nowMs() >= endTime) {
-        return bestValue;
-      }
+    if (shouldStop()) {
+      return bestValue;
     }
   }
 
-  storeEntry(board, TT, MoveCTX(),
+  storeEntry(position, TT, MoveCTX(),
              {.ply = ply,
               .depth = 0,
               .bestScore = bestValue,
               .alphaOriginal = alphaOriginal,
-              .beta = beta});
+              .beta = beta,
+              .staticEval = staticEvaluation});
 
   return bestValue;
 }
@@ -0,0 +1,94 @@
+#include "timeManager.h"
+#include "legalMoves.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+// Moves the rest of the clock is spread over in sudden death, and the most a
+// `movestogo` is trusted with
+static constexpr std::int64_t DEFAULT_MOVES_TO_GO = 30;
+static constexpr std::int64_t MAX_MOVES_TO_GO = 50;
+
+// Soft limit as a percent of the old single limit. An iteration started just
+// before the soft limit runs well past it, and that is a bigger share of a
+// short budget than of a long one. So the percent falls from the short end to
+// the long one, and both blitz and rapid average the time the old limit gave
+static constexpr std::int64_t SHORT_SOFT_PERCENT = 55;
+static constexpr std::int64_t LONG_SOFT_PERCENT = 40;
+static constexpr std::int64_t SHORT_OPTIMUM_MS = 400;
+static constexpr std::int64_t LONG_OPTIMUM_MS = 2300;
+
+static auto softPercent(const std::int64_t optimumMs) -> std::int64_t {
+  const std::int64_t clamped =
+      std::clamp(optimumMs, SHORT_OPTIMUM_MS, LONG_OPTIMUM_MS);
+  return SHORT_SOFT_PERCENT - (SHORT_SOFT_PERCENT - LONG_SOFT_PERCENT) *
+                                  (clamped - SHORT_OPTIMUM_MS) /
+                                  (LONG_OPTIMUM_MS - SHORT_OPTIMUM_MS);
+}
+
+// Soft limit in percent, by how many iterations in a row returned the same
+// best move. A move that just changed gets half as much again, one that held
+// for four iterations less than three quarters
+static constexpr std::array<std::uint32_t, 5> STABILITY_PERCENT = {
+    150, 125, 100, 85, 70};
+
+// A falling score gets up to half as much time again, one percent per two
+// centipawns lost since the last iteration
+static constexpr std::int32_t MAX_SCORE_DROP = 100;
+
+auto TimeManager::fixed(const std::uint64_t moveTimeMs) -> TimeManager {
+  TimeManager manager;
+  manager.soft = moveTimeMs;
+  manager.hard = moveTimeMs;
+  return manager;
+}
+
+auto TimeManager::fromClock(const std::int64_t timeMs,
+                            const std::int64_t incrementMs,
+                            const std::uint32_t movesToGo) -> TimeManager {
+  const std::int64_t available = std::max<std::int64_t>(
+      timeMs - static_cast<std::int64_t>(MOVE_OVERHEAD_MS), 1);
+  const std::int64_t moves =
+      movesToGo == 0 ? DEFAULT_MOVES_TO_GO
+                     : std::min<std::int64_t>(movesToGo, MAX_MOVES_TO_GO);
+
+  // What used to be the only limit
+  const std::int64_t optimum =
+      available / (moves + 2) + std::max<std::int64_t>(incrementMs, 0) * 2 / 3;
+
+  TimeManager manager;
+  manager.hard = std::clamp<std::int64_t>(optimum * 2, 1, available / 2 + 1);
+  manager.soft = std::clamp<std::int64_t>(
+      optimum * softPercent(optimum) / 100, 1, manager.hard);
+  manager.scalable = true;
+  return manager;
+}
+
+auto TimeManager::softLimit() const -> std::uint64_t {
+  if (!scalable) {
+    return soft;
+  }
+
+  const std::uint64_t scaled =
+      soft * STABILITY_PERCENT[stability] / 100 * scorePercent / 100;
+  return std::min(scaled, hard);
+}
+
+void TimeManager::update(const MoveCTX &bestMove, const std::int32_t score) {
+  if (iterations == 0) {
+    // Nothing to compare with yet, stability stays neutral
+  } else if (bestMove == previousMove) {
+    stability = std::min<std::uint8_t>(stability + 1,
+                                       STABILITY_PERCENT.size() - 1);
+  } else {
+    stability = 0;
+  }
+
+  const std::int32_t drop =
+      std::clamp(previousScore - score, 0, MAX_SCORE_DROP);
+  scorePercent = iterations == 0 ? 100 : 100 + drop / 2;
+
+  previousMove = bestMove;
+  previousScore = score;
+  iterations = std::min<std::uint8_t>(iterations + 1, UINT8_MAX);
+}
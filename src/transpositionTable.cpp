@@ -0,0 +1,283 @@
+#include "searching.h"
+#include "zobrist.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1048576;
+
+static constexpr std::uint64_t HASH_FILE_MAGIC = 0x4854534F48544E54; // TNTHOSTH
+static constexpr std::uint32_t HASH_FILE_VERSION = 1;
+// The clusters start one page in, so they can be mapped straight from the file
+static constexpr std::size_t HASH_FILE_HEADER_SIZE = 4096;
+
+struct HashFileHeader {
+  std::uint64_t magic = HASH_FILE_MAGIC;
+  std::uint32_t version = HASH_FILE_VERSION;
+  std::uint32_t clusterSize = sizeof(TTCluster);
+  std::uint64_t clusterCount = 0;
+  std::uint64_t zobristSignature = 0;
+  std::uint8_t generation = 0;
+};
+
+static_assert(sizeof(HashFileHeader) <= HASH_FILE_HEADER_SIZE);
+
+void TranspositionTable::allocate(const std::size_t bytes) {
+#ifdef __linux__
+  const std::size_t roundedBytes =
+      (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+  // Only works if the admin reserved pages in /proc/sys/vm/nr_hugepages
+  void *memory = mmap(nullptr, roundedBytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (memory != MAP_FAILED) {
+    mapping = memory;
+    table = static_cast<TTCluster *>(memory);
+    allocatedBytes = roundedBytes;
+    memoryBacking = TTBacking::HUGETLB;
+    return;
+  }
+
+  // Transparent huge pages need the range to be 2 MB aligned, so map one huge
+  // page more than needed and start the table at the first boundary
+  const std::size_t mappedBytes = roundedBytes + HUGE_PAGE_SIZE;
+  memory = mmap(nullptr, mappedBytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory != MAP_FAILED) {
+    const auto address = reinterpret_cast<std::uintptr_t>(memory);
+    const std::uintptr_t aligned =
+        (address + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    mapping = memory;
+    table = reinterpret_cast<TTCluster *>(aligned);
+    allocatedBytes = mappedBytes;
+    memoryBacking = madvise(table, roundedBytes, MADV_HUGEPAGE) == 0
+                        ? TTBacking::TRANSPARENT_HUGE
+                        : TTBacking::REGULAR;
+    return;
+  }
+#endif
+
+  // May throw, nothing is assigned before it returns
+  table = static_cast<TTCluster *>(
+      ::operator new(bytes, std::align_val_t{alignof(TTCluster)}));
+  mapping = nullptr;
+  allocatedBytes = bytes;
+  memoryBacking = TTBacking::REGULAR;
+}
+
+static void freeClusters(TTCluster *table, void *mapping,
+                         const std::size_t bytes) {
+  if (table == nullptr) {
+    return;
+  }
+
+#ifdef __linux__
+  if (mapping != nullptr) {
+    munmap(mapping, bytes);
+    return;
+  }
+#endif
+
+  ::operator delete(table, std::align_val_t{alignof(TTCluster)});
+}
+
+void TranspositionTable::release() {
+  freeClusters(table, mapping, allocatedBytes);
+
+  mapping = nullptr;
+  table = nullptr;
+  clusterCount = 0;
+  allocatedBytes = 0;
+}
+
+void TranspositionTable::resize(const std::size_t megabytes,
+                                const std::uint32_t threads) {
+  const std::size_t clusters =
+      std::bit_floor(megabytes * MB_TO_BYTE_SCALE_FACTOR / sizeof(TTCluster));
+
+  // The old table goes only once the new one is in. If the allocation throws
+  // the table is left as it was, still usable by the next search
+  TTCluster *const oldTable = table;
+  void *const oldMapping = mapping;
+  const std::size_t oldBytes = allocatedBytes;
+  allocate(clusters * sizeof(TTCluster));
+  freeClusters(oldTable, oldMapping, oldBytes);
+
+  clusterCount = clusters;
+  indexMask = clusters - 1;
+  generation = 0;
+
+  // Anonymous mappings are already zero, which is an empty table
+  if (mapping == nullptr) {
+    clear(threads);
+  }
+}
+
+void TranspositionTable::clear(const std::uint32_t threads) {
+  generation = 0;
+
+#ifdef __linux__
+  // Dropped pages of an anonymous mapping come back zeroed when a search
+  // thread first touches them, like after resize(). A file mapping would come
+  // back as the file, so it is zeroed below
+  if (mapping != nullptr && memoryBacking != TTBacking::FILE &&
+      madvise(mapping, allocatedBytes, MADV_DONTNEED) == 0) {
+    if (memoryBacking == TTBacking::TRANSPARENT_HUGE) {
+      madvise(table, clusterCount * sizeof(TTCluster), MADV_HUGEPAGE);
+    }
+    return;
+  }
+#endif
+
+  const std::size_t workerCount =
+      std::clamp<std::size_t>(threads, 1, clusterCount);
+  const std::size_t slice = clusterCount / workerCount;
+
+  auto clearSlice = [this, slice, workerCount](const std::size_t index) {
+    const std::size_t start = index * slice;
+    const std::size_t count =
+        index == workerCount - 1 ? clusterCount - start : slice;
+    std::fill_n(table + start, count, TTCluster{});
+  };
+
+  if (workerCount == 1) {
+    clearSlice(0);
+    return;
+  }
+
+  std::vector<std::jthread> workers;
+  workers.reserve(workerCount);
+  for (std::size_t i = 0; i < workerCount; i++) {
+    workers.emplace_back(clearSlice, i);
+  }
+}
+
+auto TranspositionTable::backingName() const -> const char * {
+  switch (memoryBacking) {
+  case TTBacking::HUGETLB:
+    return "huge pages (MAP_HUGETLB)";
+  case TTBacking::TRANSPARENT_HUGE:
+    return "transparent huge pages (MADV_HUGEPAGE)";
+  case TTBacking::FILE:
+    return "hash file (copy-on-write mapping)";
+  default:
+    return "regular pages";
+  }
+}
+
+auto TranspositionTable::save(const std::string &path) const -> bool {
+  HashFileHeader header;
+  header.clusterCount = clusterCount;
+  header.zobristSignature = ZOBRIST_SIGNATURE;
+  header.generation = generation;
+
+  std::array<char, HASH_FILE_HEADER_SIZE> headerPage{};
+  std::memcpy(headerPage.data(), &header, sizeof(header));
+
+  const std::string temporaryPath = path + ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+    file.write(headerPage.data(), headerPage.size());
+    file.write(reinterpret_cast<const char *>(table),
+               static_cast<std::streamsize>(clusterCount * sizeof(TTCluster)));
+    if (!file.good()) {
+      file.close();
+      std::remove(temporaryPath.c_str());
+      return false;
+    }
+  }
+
+  // Replacing the directory entry leaves a mapped old file intact
+  return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+auto TranspositionTable::load(const std::string &path) -> bool {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+  const auto fileSize = static_cast<std::size_t>(file.tellg());
+
+  HashFileHeader header;
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+  if (!file.good() || header.magic != HASH_FILE_MAGIC ||
+      header.version != HASH_FILE_VERSION ||
+      header.clusterSize != sizeof(TTCluster) ||
+      header.zobristSignature != ZOBRIST_SIGNATURE ||
+      !std::has_single_bit(header.clusterCount) ||
+      fileSize < HASH_FILE_HEADER_SIZE) {
+    return false;
+  }
+
+  // Bounded before multiplying, a huge count would wrap the size check below
+  static constexpr std::size_t MAX_CLUSTERS =
+      MAX_SIZE_MB * MB_TO_BYTE_SCALE_FACTOR / sizeof(TTCluster);
+  if (header.clusterCount > MAX_CLUSTERS ||
+      header.clusterCount >
+          (fileSize - HASH_FILE_HEADER_SIZE) / sizeof(TTCluster)) {
+    return false;
+  }
+
+  const std::size_t bytes = header.clusterCount * sizeof(TTCluster);
+  if (fileSize != HASH_FILE_HEADER_SIZE + bytes) {
+    return false;
+  }
+
+#ifdef __linux__
+  const int descriptor = open(path.c_str(), O_RDONLY);
+  if (descriptor < 0) {
+    return false;
+  }
+  // Private and writable, searching on never writes back to the file
+  void *memory = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      descriptor, 0);
+  close(descriptor);
+  if (memory == MAP_FAILED) {
+    return false;
+  }
+
+  release();
+  mapping = memory;
+  table = reinterpret_cast<TTCluster *>(static_cast<char *>(memory) +
+                                        HASH_FILE_HEADER_SIZE);
+  allocatedBytes = fileSize;
+  memoryBacking = TTBacking::FILE;
+#else
+  // Read into a buffer of its own, a short read must leave the table alone
+  auto *clusters = static_cast<TTCluster *>(
+      ::operator new(bytes, std::align_val_t{alignof(TTCluster)}));
+  file.seekg(HASH_FILE_HEADER_SIZE);
+  file.read(reinterpret_cast<char *>(clusters),
+            static_cast<std::streamsize>(bytes));
+  if (!file.good()) {
+    ::operator delete(clusters, std::align_val_t{alignof(TTCluster)});
+    return false;
+  }
+
+  release();
+  table = clusters;
+  allocatedBytes = bytes;
+  memoryBacking = TTBacking::REGULAR;
+#endif
+
+  clusterCount = header.clusterCount;
+  indexMask = clusterCount - 1;
+  generation = header.generation;
+  return true;
+}
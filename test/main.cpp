@@ -1,6 +1,10 @@
 #include "./move.cpp"
 #include "./moveSorting.cpp"
 #include "./parsing.cpp"
+#include "./perft.cpp"
+#include "./searching.cpp"
+#include "./timeManager.cpp"
+#include "./transpositionTable.cpp"
 #include "gtest/gtest.h"
 
 auto main(int argc, char **argv) -> int {
@@ -3,6 +3,7 @@
 #include "board.h"
 #include "legalMoves.h"
 #include "gtest/gtest.h"
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <random>
@@ -28,6 +29,17 @@ protected:
     }
     return std::make_pair(Piece::NOTHING, false);
   }
+
+  // The incrementally kept flats and mailbox must match a rebuild from the
+  // bitboards
+  static void expectOccupancyInSync(const ChessBoard &board) {
+    ChessBoard rebuilt = board;
+    rebuilt.updateOccupancy();
+    EXPECT_EQ(board.whiteFlat, rebuilt.whiteFlat);
+    EXPECT_EQ(board.blackFlat, rebuilt.blackFlat);
+    EXPECT_EQ(board.occupied, rebuilt.occupied);
+    EXPECT_EQ(board.mailbox, rebuilt.mailbox);
+  }
 };
 
 TEST_F(MakeMoveTest, QuietPawnMove) {
@@ -215,6 +227,7 @@ TEST_F(MakeMoveTest, CastlingKingSide) {
 
   // Verify Zobrist hash updated
   EXPECT_NE(board.zobrist, initialBoard.zobrist);
+  expectOccupancyInSync(board);
 
   undoMove(board, undo);
 
@@ -222,6 +235,7 @@ TEST_F(MakeMoveTest, CastlingKingSide) {
     EXPECT_EQ(initialBoard.whites[type], board.whites[type]);
     EXPECT_EQ(initialBoard.blacks[type], board.blacks[type]);
   }
+  expectOccupancyInSync(board);
 }
 
 TEST_F(MakeMoveTest, CastlingQueenSide) {
@@ -355,6 +369,36 @@ TEST_F(MakeMoveTest, CaptureRookAffectsCastling) {
   }
 }
 
+// Undo records own their move, so a whole line can be unwound from a stack
+// after the moves it was made from are gone
+TEST_F(MakeMoveTest, UnwindsALineFromAnUndoStack) {
+  ChessBoard board("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  const ChessBoard initialBoard = board;
+
+  const std::array<std::string, 8> line = {"e2e4", "d7d5", "e4d5", "g8f6",
+                                           "f1b5", "c7c6", "d5c6", "b8c6"};
+  std::array<UndoCTX, line.size()> undoStack;
+  for (std::size_t i = 0; i < line.size(); i++) {
+    undoStack[i] = UndoCTX(fromAlgebraic(line[i], board), board);
+    makeMove(board, undoStack[i].move);
+  }
+
+  for (std::size_t i = line.size(); i > 0; i--) {
+    undoMove(board, undoStack[i - 1]);
+  }
+
+  for (std::uint32_t type = Piece::PAWN; type <= Piece::KING; type++) {
+    EXPECT_EQ(initialBoard.whites[type], board.whites[type]);
+    EXPECT_EQ(initialBoard.blacks[type], board.blacks[type]);
+  }
+  EXPECT_EQ(initialBoard.zobrist, board.zobrist);
+  EXPECT_EQ(initialBoard.getCompressedCastlingRights(),
+            board.getCompressedCastlingRights());
+  EXPECT_EQ(initialBoard.enPassantSquare, board.enPassantSquare);
+  EXPECT_TRUE(board.whiteToMove);
+  expectOccupancyInSync(board);
+}
+
 TEST_F(MakeMoveTest, ZobristPropertyBasedTest) {
   static constexpr std::size_t RANDOM_TESTS = 1000;
   // Seed for reproducible randomness
@@ -364,7 +408,7 @@ TEST_F(MakeMoveTest, ZobristPropertyBasedTest) {
   // Test 1000 random positions
   for (std::size_t test = 0; test < RANDOM_TESTS; test++) {
     // Create random position
-    ChessBoard board;
+    ChessBoard board{};
     board.whiteToMove = (dis(gen) % 2) != 0;
     static constexpr std::uint32_t EN_PASSANT_FILE_MULTIPLIER = 5;
     board.enPassantSquare =
@@ -393,18 +437,53 @@ TEST_F(MakeMoveTest, ZobristPropertyBasedTest) {
       }
     }
 
+    // Castling moves a rook, which has to be there along with the king
+    auto canCastle = [](const std::array<std::uint64_t, Piece::KING + 1> &color,
+                        const std::uint32_t king, const std::uint32_t rook) {
+      return (color[Piece::KING] & (1ULL << king)) != 0 &&
+             (color[Piece::ROOK] & (1ULL << rook)) != 0;
+    };
+    board.castlingRights.whiteKingSide = board.castlingRights.whiteKingSide &&
+                                         canCastle(board.whites, E1, H1);
+    board.castlingRights.whiteQueenSide =
+        board.castlingRights.whiteQueenSide && canCastle(board.whites, E1, A1);
+    board.castlingRights.blackKingSide = board.castlingRights.blackKingSide &&
+                                         canCastle(board.blacks, E8, H8);
+    board.castlingRights.blackQueenSide =
+        board.castlingRights.blackQueenSide && canCastle(board.blacks, E8, A8);
+
+    board.updateOccupancy();
+
+    // En passant needs the pawn that just double pushed, and nothing on the
+    // squares it skipped
+    if (board.enPassantSquare != 0) {
+      const std::uint32_t square = board.enPassantSquare;
+      const std::uint32_t pushedTo =
+          board.whiteToMove ? square - BOARD_LENGTH : square + BOARD_LENGTH;
+      const std::uint32_t pushedFrom =
+          board.whiteToMove ? square + BOARD_LENGTH : square - BOARD_LENGTH;
+      const auto &pusher = board.whiteToMove ? board.blacks : board.whites;
+      if (square / BOARD_LENGTH != (board.whiteToMove ? 5U : 2U) ||
+          (pusher[Piece::PAWN] & (1ULL << pushedTo)) == 0 ||
+          (board.occupied & ((1ULL << square) | (1ULL << pushedFrom))) != 0) {
+        board.enPassantSquare = 0;
+      }
+    }
+
     // Calculate initial hash from scratch
     const std::uint64_t initialHash = board.calculateZobrist();
 
     board.zobrist = initialHash;
 
+    const ChessBoard initialBoard = board;
+
     // Generate all legal moves
     MoveGenerator generator(board);
     generator.generatePseudoLegal(false, board.whiteToMove);
     generator.appendCastling(board, board.whiteToMove);
 
     // Test each move
-    for (const auto &move : generator.pseudoLegal) {
+    for (const auto &move : generator.moves) {
       // Save state for undo
       const UndoCTX undo(move, board);
 
@@ -424,19 +503,18 @@ TEST_F(MakeMoveTest, ZobristPropertyBasedTest) {
       const std::uint64_t newCalculatedHash = board.calculateZobrist();
 
       EXPECT_EQ(board.zobrist, newCalculatedHash) << "Hash mismatch after move";
+      expectOccupancyInSync(board);
 
       // Property 3: Undo should restore original hash
       undoMove(board, undo);
       EXPECT_EQ(board.zobrist, initialHash) << "Hash not restored after undo";
+      expectOccupancyInSync(board);
 
       // Property 4: Making and undoing move should leave board unchanged
       for (int piece = Piece::PAWN; piece <= Piece::KING; piece++) {
-        EXPECT_EQ(undo.move.original == piece
-                      ? (board.whites[piece] | (1ULL << move.from))
-                      : board.whites[piece],
-                  board.whites[piece])
+        EXPECT_EQ(initialBoard.whites[piece], board.whites[piece])
             << "White pieces not restored";
-        EXPECT_EQ(board.blacks[piece], board.blacks[piece])
+        EXPECT_EQ(initialBoard.blacks[piece], board.blacks[piece])
             << "Black pieces not restored";
       }
     }
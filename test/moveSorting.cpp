@@ -1,6 +1,10 @@
 #include "board.h"
 #include "legalMoves.h"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
 
 class MoveSortingTest : public ::testing::Test {
 protected:
@@ -20,3 +24,62 @@ TEST_F(MoveSortingTest, SEEPosition2) {
 
   EXPECT_EQ(move.see(board.getFlat(true), board, board.getFlat(false)), -220);
 }
+
+TEST_F(MoveSortingTest, MovePickerHandsOutEveryMoveOnce) {
+  const ChessBoard board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> killers{};
+  std::array<std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
+      history{};
+
+  MoveGenerator generator(board);
+  generator.generatePseudoLegal(false, board.whiteToMove);
+  generator.appendCastling(board, board.whiteToMove);
+
+  const MoveCTX ttMove = fromAlgebraic("e2a6", board);
+  killers[0][0] = fromAlgebraic("a2a3", board);
+
+  MovePicker picker(board, ttMove.pack(), killers, history, 0, false);
+  std::vector<std::uint16_t> picked;
+  MoveCTX move;
+  while (picker.next(move)) {
+    if (picked.empty()) {
+      EXPECT_EQ(picker.stage(), MoveStage::TT);
+      EXPECT_EQ(move, ttMove);
+    }
+    if (move == killers[0][0]) {
+      EXPECT_EQ(picker.stage(), MoveStage::KILLERS);
+    }
+    picked.push_back(move.pack());
+  }
+
+  std::vector<std::uint16_t> generated;
+  for (const MoveCTX &generatedMove : generator.moves) {
+    generated.push_back(generatedMove.pack());
+  }
+
+  std::ranges::sort(picked);
+  std::ranges::sort(generated);
+  EXPECT_EQ(picked, generated);
+}
+
+TEST_F(MoveSortingTest, MovePickerOnlyCaptures) {
+  const ChessBoard board(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::array<std::array<MoveCTX, 2>, MAX_DEPTH + 1> killers{};
+  std::array<std::array<std::array<std::uint16_t, BOARD_AREA>, BOARD_AREA>, 2>
+      history{};
+
+  // A quiet TT move isn't handed out when only captures are wanted
+  MovePicker picker(board, fromAlgebraic("a2a3", board).pack(), killers,
+                    history, 0, true);
+  MoveCTX move;
+  std::size_t count = 0;
+  while (picker.next(move)) {
+    EXPECT_NE(move.captured, Piece::NOTHING);
+    EXPECT_EQ(picker.stage(), MoveStage::GOOD_CAPTURES);
+    EXPECT_GE(move.see(board.getFlat(true), board, board.getFlat(false)), 0);
+    count++;
+  }
+  EXPECT_GT(count, 0U);
+}
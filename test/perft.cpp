@@ -0,0 +1,73 @@
+#include "board.h"
+#include "perft.h"
+#include "gtest/gtest.h"
+#include <cstdint>
+#include <string>
+
+class PerftTest : public ::testing::Test {
+protected:
+  static auto perftOf(const std::string &fen, const std::uint8_t depth)
+      -> std::uint64_t {
+    ChessBoard board(fen);
+    return perft(depth, board, false);
+  }
+};
+
+// Reference counts from the Chess Programming Wiki perft results page
+
+TEST_F(PerftTest, StartingPosition) {
+  EXPECT_EQ(
+      perftOf("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 4),
+      197281U);
+}
+
+TEST_F(PerftTest, Kiwipete) {
+  EXPECT_EQ(perftOf("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                    "w KQkq - 0 1",
+                    3),
+            97862U);
+}
+
+// Horizontal pins and en passant discovering a check along the rank
+TEST_F(PerftTest, Position3) {
+  EXPECT_EQ(perftOf("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5), 674624U);
+}
+
+// Checks, promotions and castling through attacked squares
+TEST_F(PerftTest, Position4) {
+  EXPECT_EQ(perftOf("r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 "
+                    "w kq - 0 1",
+                    3),
+            9467U);
+}
+
+TEST_F(PerftTest, Position5) {
+  EXPECT_EQ(
+      perftOf("rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 3),
+      62379U);
+}
+
+// A table small enough to collide a lot must still give exact counts
+TEST_F(PerftTest, HashedPerftMatches) {
+  PerftTable table(1);
+  ChessBoard board("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R "
+                   "w KQkq - 0 1");
+
+  EXPECT_EQ(perft(4, board, false, &table), 4085603U);
+  // Second run is answered from the table
+  EXPECT_EQ(perft(4, board, false, &table), 4085603U);
+  EXPECT_EQ(perft(3, board, false, &table), 97862U);
+}
+
+TEST_F(PerftTest, SuitePasses) { EXPECT_TRUE(perftSuite(3)); }
+
+TEST_F(PerftTest, ParallelPerftMatches) {
+  PerftTable table(1);
+  const ChessBoard board("r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/"
+                         "1PP1QPPP/R4RK1 w - - 0 10");
+
+  EXPECT_EQ(parallelPerft(4, board, false, 4), 3894594U);
+  EXPECT_EQ(parallelPerft(4, board, false, 4, &table), 3894594U);
+  // Too shallow to split
+  EXPECT_EQ(parallelPerft(2, board, false, 4), 2079U);
+}
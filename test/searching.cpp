@@ -0,0 +1,212 @@
+#include "board.h"
+#include "move.h"
+#include "searching.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Counts every plain `new` of the test binary while `countAllocations` is set
+static std::atomic<bool> countAllocations = false;
+static std::atomic<std::uint64_t> allocationCount = 0;
+
+auto operator new(const std::size_t size) -> void * {
+  if (countAllocations.load(std::memory_order_relaxed)) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (void *memory = std::malloc(size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+// GCC can't tell these pair with the `new` above once they are inlined
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t /*size*/) noexcept {
+  std::free(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+class SearchingTest : public ::testing::Test {
+protected:
+  ChessBoard board = ChessBoard(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  TranspositionTable TT;
+  Searching searcher = Searching(board, TT);
+};
+
+TEST_F(SearchingTest, SearchDoesNotAllocate) {
+  static constexpr std::uint8_t DEPTH = 5;
+
+  allocationCount = 0;
+  countAllocations = true;
+  static_cast<void>(searcher.search(DEPTH));
+  countAllocations = false;
+
+  EXPECT_GT(searcher.nodes.load(), 0U);
+  EXPECT_EQ(allocationCount.load(), 0U);
+}
+
+// A ponder search that has reached its depth still waits for the GUI
+TEST_F(SearchingTest, PonderHoldsTheMoveUntilPonderhit) {
+  std::atomic<bool> done = false;
+  MoveCTX bestMove;
+
+  searcher.prepareSearch(true);
+  std::jthread search([&] {
+    bestMove = searcher.iterativeDeepening(TimeManager(), 2);
+    done = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_FALSE(done.load());
+
+  searcher.ponderhit();
+  search.join();
+  EXPECT_FALSE(bestMove == MoveCTX{});
+}
+
+TEST_F(SearchingTest, StopEndsAnInfiniteSearch) {
+  MoveCTX bestMove;
+
+  searcher.prepareSearch(true);
+  std::jthread search(
+      [&] { bestMove = searcher.iterativeDeepening(TimeManager()); });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  searcher.requestStop();
+  search.join();
+  EXPECT_FALSE(bestMove == MoveCTX{});
+}
+
+// Every move of the line is legal in the position the ones before it reach
+TEST_F(SearchingTest, PrincipalVariationIsPlayable) {
+  searcher.prepareSearch(false);
+  const MoveCTX bestMove = searcher.iterativeDeepening(TimeManager(), 6);
+
+  const std::span<const MoveCTX> line = searcher.principalVariation();
+  ASSERT_GE(line.size(), 2U);
+  EXPECT_TRUE(line[0] == bestMove);
+
+  ChessBoard position = board;
+  for (const MoveCTX &move : line) {
+    MoveGenerator generator(position);
+    generator.generateLegal(GenerationType::ALL, position.whiteToMove);
+    ASSERT_NE(std::find(generator.moves.begin(), generator.moves.end(), move),
+              generator.moves.end())
+        << moveToUCI(move);
+    makeMove(position, move);
+  }
+}
+
+// A second search of the same position finds exact entries under every root
+// move, its line must still go past the root move
+TEST_F(SearchingTest, PrincipalVariationSurvivesAWarmTable) {
+  static constexpr std::uint8_t DEPTH = 6;
+
+  for (std::uint8_t search = 0; search < 2; search++) {
+    searcher.prepareSearch(false);
+    static_cast<void>(searcher.iterativeDeepening(TimeManager(), DEPTH));
+    EXPECT_GE(searcher.principalVariation().size(), DEPTH - 2U);
+  }
+}
+
+TEST_F(SearchingTest, MultiPVFindsDistinctRootMoves) {
+  searcher.setMultiPV(3);
+  searcher.prepareSearch(false);
+  const MoveCTX bestMove = searcher.iterativeDeepening(TimeManager(), 4);
+
+  const std::span<const Searching::RootLine> lines = searcher.rootLines();
+  ASSERT_EQ(lines.size(), 3U);
+  EXPECT_TRUE(lines[0].moves[0] == bestMove);
+  for (std::size_t i = 0; i < lines.size(); i++) {
+    EXPECT_GE(lines[i].length, 2U);
+    for (std::size_t j = 0; j < i; j++) {
+      EXPECT_FALSE(lines[i].moves[0] == lines[j].moves[0]);
+    }
+  }
+}
+
+// The lone king has three moves, so there are only three lines to give
+TEST_F(SearchingTest, MultiPVStopsAtTheLegalMoves) {
+  board = ChessBoard("7k/8/8/8/8/8/8/K7 w - - 0 1");
+  searcher.setMultiPV(5);
+  searcher.prepareSearch(false);
+  static_cast<void>(searcher.iterativeDeepening(TimeManager(), 3));
+
+  EXPECT_EQ(searcher.rootLines().size(), 3U);
+}
+
+class RepetitionTest : public ::testing::Test {
+protected:
+  ChessBoard board = ChessBoard(
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  TranspositionTable TT;
+  Searching searcher = Searching(board, TT);
+
+  void SetUp() override {
+    searcher.clearKeys();
+    searcher.pushGameKey(board);
+  }
+
+  void play(const std::vector<std::string> &moves) {
+    for (const std::string &move : moves) {
+      makeMove(board, fromAlgebraic(move, board));
+      searcher.pushGameKey(board);
+    }
+  }
+};
+
+TEST_F(RepetitionTest, ThreefoldInTheGame) {
+  play({"g1f3", "g8f6", "f3g1", "f6g8"});
+  EXPECT_FALSE(searcher.isRepetition(board, 0));
+
+  play({"g1f3", "g8f6", "f3g1", "f6g8"});
+  EXPECT_TRUE(searcher.isRepetition(board, 0));
+}
+
+// The last `ply` keys pushed stand in for the search path here
+TEST_F(RepetitionTest, OnceInsideTheSearchTree) {
+  play({"g1f3", "g8f6", "f3g1", "f6g8"});
+  // Repeats the starting position, which is before the root
+  EXPECT_FALSE(searcher.isRepetition(board, 4));
+
+  play({"g1f3"});
+  // Repeats the position after the first g1f3, the first move of the search
+  EXPECT_TRUE(searcher.isRepetition(board, 5));
+}
+
+// Far enough back that a six-key window would have missed it
+TEST_F(RepetitionTest, LongCycle) {
+  const std::vector<std::string> cycle = {"g1f3", "g8f6", "b1c3", "b8c6",
+                                          "c3b1", "c6b8", "f3g1", "f6g8"};
+  play(cycle);
+  play(cycle);
+  EXPECT_TRUE(searcher.isRepetition(board, 0));
+}
+
+TEST_F(RepetitionTest, CountsFromTheLastIrreversibleMove) {
+  play({"g1f3", "g8f6", "f3g1", "f6g8", "e2e3", "e7e6", "g1f3", "g8f6",
+        "f3g1", "f6g8"});
+  EXPECT_FALSE(searcher.isRepetition(board, 4));
+
+  play({"g1f3", "g8f6", "f3g1", "f6g8"});
+  EXPECT_TRUE(searcher.isRepetition(board, 4));
+}
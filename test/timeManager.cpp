@@ -0,0 +1,81 @@
+#include "legalMoves.h"
+#include "timeManager.h"
+#include "gtest/gtest.h"
+#include <cstdint>
+
+class TimeManagerTest : public ::testing::Test {
+protected:
+  static constexpr MoveCTX E2E4 = {.from = 12, .to = 28};
+  static constexpr MoveCTX D2D4 = {.from = 11, .to = 27};
+
+  // Two iterations in a row agree on e2e4
+  static auto settled() -> TimeManager {
+    TimeManager time = TimeManager::fromClock(60000, 0, 0);
+    for (std::uint8_t i = 0; i < 2; i++) {
+      time.update(E2E4, 20);
+    }
+    return time;
+  }
+};
+
+TEST_F(TimeManagerTest, DefaultIsUnlimited) {
+  const TimeManager time;
+  EXPECT_FALSE(time.isLimited());
+  EXPECT_TRUE(time.shouldStartIteration(UINT64_MAX - 1));
+}
+
+TEST_F(TimeManagerTest, MoveTimeIsNeverScaled) {
+  TimeManager time = TimeManager::fixed(500);
+  time.update(E2E4, 20);
+  time.update(D2D4, -300);
+
+  EXPECT_EQ(time.softLimit(), 500U);
+  EXPECT_EQ(time.hardLimit(), 500U);
+}
+
+TEST_F(TimeManagerTest, SoftLimitStaysUnderTheHardOne) {
+  const TimeManager sudden = TimeManager::fromClock(60000, 0, 0);
+  EXPECT_LT(sudden.softLimit(), sudden.hardLimit());
+  EXPECT_LE(sudden.hardLimit(), 30000U);
+
+  // One move to the time control, every extension must still fit
+  TimeManager last = TimeManager::fromClock(1000, 0, 1);
+  last.update(E2E4, 0);
+  last.update(D2D4, -500);
+  EXPECT_LE(last.softLimit(), last.hardLimit());
+  EXPECT_LE(last.hardLimit(), 500U);
+}
+
+// The last iteration overshoots a short budget by more of it, so blitz keeps
+// a larger share of the old limit as its soft limit than rapid does
+TEST_F(TimeManagerTest, ShortBudgetKeepsALargerShare) {
+  const TimeManager blitz = TimeManager::fromClock(10000, 100, 0);
+  const TimeManager rapid = TimeManager::fromClock(60000, 600, 0);
+
+  EXPECT_GT(blitz.softLimit() * 100 / blitz.hardLimit(),
+            rapid.softLimit() * 100 / rapid.hardLimit());
+}
+
+TEST_F(TimeManagerTest, StableMoveStopsEarlier) {
+  const TimeManager fresh = TimeManager::fromClock(60000, 0, 0);
+  TimeManager time = settled();
+  const std::uint64_t before = time.softLimit();
+  EXPECT_LT(before, fresh.softLimit());
+
+  time.update(E2E4, 20);
+  EXPECT_LT(time.softLimit(), before);
+}
+
+TEST_F(TimeManagerTest, NewBestMoveOrFallingScoreExtends) {
+  const std::uint64_t stable = settled().softLimit();
+
+  TimeManager changed = settled();
+  changed.update(D2D4, 20);
+  EXPECT_GT(changed.softLimit(), stable);
+
+  TimeManager falling = settled();
+  falling.update(E2E4, -80);
+  TimeManager holding = settled();
+  holding.update(E2E4, 20);
+  EXPECT_GT(falling.softLimit(), holding.softLimit());
+}
@@ -0,0 +1,257 @@
+#include "searching.h"
+#include "gtest/gtest.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+class TranspositionTableTest : public ::testing::Test {
+protected:
+  TranspositionTable table;
+
+  // Every field is derived from `depth`, so a torn entry can't look valid
+  static auto entryForDepth(const std::uint8_t depth) -> TTEntry {
+    return {
+        .bestMove = static_cast<std::uint16_t>(depth + 1),
+        .score = static_cast<std::int16_t>(depth * 10),
+        .staticEval = static_cast<std::int16_t>(-depth),
+        .depth = depth,
+        .flag = TTEntry::EXACT,
+        .age = 0,
+    };
+  }
+
+  static auto isConsistent(const TTEntry &entry) -> bool {
+    return entry.bestMove == entry.depth + 1 &&
+           entry.score == entry.depth * 10 && entry.staticEval == -entry.depth;
+  }
+};
+
+TEST_F(TranspositionTableTest, PackRoundTrip) {
+  const TTEntry entry = {
+      .bestMove = 0xABCD,
+      .score = -CHECKMATE_SCORE,
+      .staticEval = 1234,
+      .depth = MAX_SEARCHING_DEPTH,
+      .flag = TTEntry::UPPERBOUND,
+      .age = 0x2A,
+  };
+
+  const TTEntry unpacked = TTEntry::unpack(entry.pack());
+
+  EXPECT_EQ(unpacked.bestMove, entry.bestMove);
+  EXPECT_EQ(unpacked.score, entry.score);
+  EXPECT_EQ(unpacked.staticEval, entry.staticEval);
+  EXPECT_EQ(unpacked.depth, entry.depth);
+  EXPECT_EQ(unpacked.flag, entry.flag);
+  EXPECT_EQ(unpacked.age, entry.age);
+}
+
+TEST_F(TranspositionTableTest, StoreThenProbe) {
+  const std::uint64_t key = 0x123456789ABCDEF0ULL;
+  TTEntry entry;
+
+  EXPECT_FALSE(table.probe(key, entry));
+
+  table.store(key, entryForDepth(5));
+  ASSERT_TRUE(table.probe(key, entry));
+  EXPECT_EQ(entry.depth, 5);
+  EXPECT_TRUE(isConsistent(entry));
+
+  // Same cluster, different verification bits
+  EXPECT_FALSE(table.probe(key ^ (1ULL << 63), entry));
+
+  table.clear();
+  EXPECT_FALSE(table.probe(key, entry));
+}
+
+TEST_F(TranspositionTableTest, KeepsDeeperEntryOfCurrentSearch) {
+  const std::uint64_t key = 0xFEDCBA9876543210ULL;
+  TTEntry entry;
+
+  table.store(key, entryForDepth(10));
+  table.store(key, entryForDepth(1));
+  ASSERT_TRUE(table.probe(key, entry));
+  EXPECT_EQ(entry.depth, 10);
+
+  // A new search makes the old result replaceable
+  table.newSearch();
+  table.store(key, entryForDepth(1));
+  ASSERT_TRUE(table.probe(key, entry));
+  EXPECT_EQ(entry.depth, 1);
+}
+
+TEST_F(TranspositionTableTest, ClearEmptiesTheTable) {
+  const std::uint64_t key = 0x0F1E2D3C4B5A6978ULL;
+  TTEntry entry;
+
+  table.resize(1);
+  table.store(key, entryForDepth(5));
+  table.clear();
+  EXPECT_FALSE(table.probe(key, entry));
+  EXPECT_EQ(table.hashfull(), 0U);
+
+  // The released pages must be usable again
+  table.store(key, entryForDepth(5));
+  ASSERT_TRUE(table.probe(key, entry));
+  EXPECT_EQ(entry.depth, 5);
+}
+
+TEST_F(TranspositionTableTest, SaveThenLoad) {
+  const std::uint64_t key = 0x0F1E2D3C4B5A6978ULL;
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "tanathosSaveThenLoad.hash")
+          .string();
+
+  table.resize(1);
+  table.store(key, entryForDepth(7));
+  ASSERT_TRUE(table.save(path));
+
+  TranspositionTable loaded;
+  TTEntry entry;
+  ASSERT_TRUE(loaded.load(path));
+  EXPECT_EQ(loaded.size(), table.size());
+  ASSERT_TRUE(loaded.probe(key, entry));
+  EXPECT_EQ(entry.depth, 7);
+  EXPECT_TRUE(isConsistent(entry));
+
+  // Overwriting the file that backs `loaded` must leave the mapping readable
+  table.clear();
+  ASSERT_TRUE(table.save(path));
+  EXPECT_TRUE(loaded.probe(key, entry));
+
+  std::filesystem::remove(path);
+}
+
+TEST_F(TranspositionTableTest, RejectsInvalidHashFile) {
+  const std::uint64_t key = 0x0F1E2D3C4B5A6978ULL;
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "tanathosInvalid.hash")
+          .string();
+
+  std::ofstream(path) << "not a hash file";
+
+  table.store(key, entryForDepth(3));
+  TTEntry entry;
+  EXPECT_FALSE(table.load(path));
+  EXPECT_FALSE(table.load(path + ".missing"));
+  EXPECT_TRUE(table.probe(key, entry));
+
+  std::filesystem::remove(path);
+}
+
+// A real header whose cluster count times the cluster size wraps around to
+// the size of a file that holds nothing but the header
+TEST_F(TranspositionTableTest, RejectsOverflowingClusterCount) {
+  const std::uint64_t key = 0x0F1E2D3C4B5A6978ULL;
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "tanathosOverflow.hash")
+          .string();
+
+  table.resize(1);
+  table.store(key, entryForDepth(3));
+  ASSERT_TRUE(table.save(path));
+  std::filesystem::resize_file(path, 4096);
+  {
+    static constexpr std::uint64_t CLUSTER_COUNT = 1ULL << 58;
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(16); // magic, version and cluster size come first
+    file.write(reinterpret_cast<const char *>(&CLUSTER_COUNT),
+               sizeof(CLUSTER_COUNT));
+  }
+
+  TTEntry entry;
+  EXPECT_FALSE(table.load(path));
+  EXPECT_EQ(table.size(), 1048576 / sizeof(TTCluster));
+  EXPECT_TRUE(table.probe(key, entry));
+
+  std::filesystem::remove(path);
+}
+
+// Caps the address space so the biggest table can't be mapped, the table
+// from before must still answer probes afterwards. Sanitizer allocators abort
+// instead of throwing, so mode.tsan skips it
+TEST_F(TranspositionTableTest, FailedResizeKeepsTheTable) {
+#if defined(__linux__) && !defined(__SANITIZE_THREAD__) &&                    \
+    !defined(__SANITIZE_ADDRESS__)
+  const std::uint64_t key = 0x0F1E2D3C4B5A6978ULL;
+
+  table.resize(1);
+  table.store(key, entryForDepth(4));
+
+  std::size_t pages = 0;
+  std::ifstream("/proc/self/statm") >> pages;
+  rlimit previous{};
+  ASSERT_EQ(getrlimit(RLIMIT_AS, &previous), 0);
+  rlimit capped = previous;
+  capped.rlim_cur = pages * sysconf(_SC_PAGESIZE) + 256 * 1048576;
+  ASSERT_EQ(setrlimit(RLIMIT_AS, &capped), 0);
+  EXPECT_THROW(table.resize(TranspositionTable::MAX_SIZE_MB), std::bad_alloc);
+  setrlimit(RLIMIT_AS, &previous);
+
+  TTEntry entry;
+  EXPECT_EQ(table.size(), 1048576 / sizeof(TTCluster));
+  ASSERT_TRUE(table.probe(key, entry));
+  EXPECT_EQ(entry.depth, 4);
+#else
+  GTEST_SKIP() << "Needs setrlimit and an allocator that throws";
+#endif
+}
+
+// Meant to be run under mode.tsan too: threads hammer the same few clusters
+// without locks, and every hit must still be an entry that was written whole
+TEST_F(TranspositionTableTest, ConcurrentStoreAndProbe) {
+  static constexpr std::uint32_t THREADS = 4;
+  static constexpr std::uint32_t ITERATIONS = 200000;
+  static constexpr std::uint8_t DEPTHS = 32;
+  static constexpr std::uint64_t KEYS = 8;
+
+  // A torn read pairs the key slot of one write with the data of another, so
+  // it's only caught if their data folds to different values
+  std::set<std::uint16_t> folds;
+  for (std::uint8_t depth = 0; depth < DEPTHS; depth++) {
+    const std::uint64_t data = entryForDepth(depth).pack();
+    folds.insert(static_cast<std::uint16_t>(data ^ (data >> 16) ^
+                                            (data >> 32) ^ (data >> 48)));
+  }
+  ASSERT_EQ(folds.size(), DEPTHS);
+
+  std::atomic<std::uint64_t> inconsistent = 0;
+  std::atomic<std::uint64_t> hits = 0;
+
+  std::vector<std::jthread> workers;
+  for (std::uint32_t thread = 0; thread < THREADS; thread++) {
+    workers.emplace_back([&, thread] {
+      for (std::uint32_t i = 0; i < ITERATIONS; i++) {
+        const std::uint64_t key = ((i + thread) % KEYS) << 48;
+        if ((i & 1) == 0) {
+          table.store(key, entryForDepth((i * (thread + 1)) % DEPTHS));
+          continue;
+        }
+
+        TTEntry entry;
+        if (table.probe(key, entry)) {
+          hits++;
+          if (!isConsistent(entry)) {
+            inconsistent++;
+          }
+        }
+      }
+    });
+  }
+  workers.clear();
+
+  EXPECT_GT(hits.load(), 0U);
+  EXPECT_EQ(inconsistent.load(), 0U);
+}
@@ -9,5 +9,7 @@ target("test")
     remove_files("../src/main.cpp")
     set_warnings("all", "error")
     add_deps("sysifus")
+    add_options("copy_make")
+    add_syslinks("pthread")
     add_rules("c++.unity_build")
     set_languages("c++20")
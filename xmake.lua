@@ -2,12 +2,21 @@ add_rules("mode.debug", "mode.release")
 
 includes("sysifus") -- pseudo-legal move generation library
 
+option("copy_make")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Search every ply on its own copy of the board instead of make/undo")
+    add_defines("COPY_MAKE")
+option_end()
+
 target("tanathos")
     set_kind("binary")
     add_includedirs("include")
     add_files("src/*.cpp")
     set_warnings("all", "error")
     add_deps("sysifus")
+    add_options("copy_make")
+    add_syslinks("pthread")
     set_languages("c++20")
 
     if is_mode("release") then
@@ -20,6 +29,6 @@ target("tanathos")
         set_symbols("debug")
     end
 
-if is_mode("debug") then
+if is_mode("debug", "asan", "tsan") then
     includes("test")
 end